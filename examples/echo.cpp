@@ -0,0 +1,104 @@
+/* TCP echo server, one C++20 coroutine per connection
+ *
+ * Each connection is a libuev::Task with its own read and write
+ * watchers, written as straight-line code with co_await.  All run in
+ * the same thread, driven by uev_run().
+ *
+ *     ./echo 7777 &
+ *     echo hello | nc -q1 localhost 7777
+ */
+
+#include <arpa/inet.h>
+#include <err.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "src/uev_coro.hpp"
+
+using namespace libuev;
+
+static Task session(Loop &loop, int sd)
+{
+	Io rd, wr;
+	char buf[4096];
+	ssize_t len;
+
+	for (;;) {
+		len = read(sd, buf, sizeof(buf));
+		if (len < 0 && errno == EAGAIN) {
+			co_await readable(loop, rd, sd);
+			continue;
+		}
+		if (len <= 0)
+			break;
+
+		for (ssize_t pos = 0, num; pos < len; pos += num) {
+			num = write(sd, buf + pos, len - pos);
+			if (num < 0) {
+				if (errno != EAGAIN)
+					goto done;
+				co_await writable(loop, wr, sd);
+				num = 0;
+			}
+		}
+	}
+done:
+	rd.stop();
+	wr.stop();
+	close(sd);
+}
+
+static Task server(Loop &loop, int ld)
+{
+	Io io;
+	int sd;
+
+	while (co_await readable(loop, io, ld) == UEV_READ) {
+		while ((sd = accept4(ld, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+			session(loop, sd);
+	}
+}
+
+static Task sigint(Loop &loop)
+{
+	Signal sig;
+
+	co_await signal(loop, sig, SIGINT);
+	warnx("Got SIGINT, exiting.");
+	loop.exit();
+}
+
+int main(int argc, char **argv)
+{
+	struct sockaddr_in sin = { };
+	int ld, on = 1;
+	Loop loop;
+
+	sin.sin_family      = AF_INET;
+	sin.sin_port        = htons(argc > 1 ? atoi(argv[1]) : 7777);
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	ld = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (ld < 0)
+		err(1, "socket");
+	setsockopt(ld, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	if (bind(ld, (struct sockaddr *)&sin, sizeof(sin)) || listen(ld, 128))
+		err(1, "bind/listen");
+
+	server(loop, ld);
+	sigint(loop);
+
+	return loop.run();
+}
+
+/**
+ * Local Variables:
+ *  compile-command: "make echo; ./echo 7777"
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -36,6 +36,20 @@ void teaser(uev_t *w, void *arg, int events)
 	puts("Sorry, you actually need to press Ctrl-\\ to exit.");
 }
 
+void reaper(uev_t *w, void *arg, int events)
+{
+	char *id = (char *)arg;
+
+	if (UEV_ERROR == events) {
+		puts("Ignoring child watcher error ...");
+		return;
+	}
+
+	/* No waitpid() loop needed, child is already reaped */
+	printf("The %s robot (PID %d) has left, status %d\n", id,
+	       w->siginfo.ssi_pid, w->siginfo.ssi_status);
+}
+
 void cleanup(uev_t *w, void *arg, int events)
 {
 	(void)arg;
@@ -55,6 +69,7 @@ int main(int argc, char **argv)
 	uev_t timerw;
 	uev_t sig1w;
 	uev_t sig2w;
+	uev_t childw;
 	char *robot;
 	pid_t pid;
 
@@ -76,6 +91,10 @@ int main(int argc, char **argv)
 	uev_signal_init(&ctx, &sig1w, teaser,  NULL, SIGINT);
 	uev_signal_init(&ctx, &sig2w, cleanup, NULL, SIGQUIT);
 
+	/* the parent keeps track of its child, no SIGCHLD handler needed */
+	if (pid > 0)
+		uev_child_init(&ctx, &childw, reaper, "Pusher", pid);
+
 	puts("Starting, press Ctrl-C to exit.");
 
 	return uev_run(&ctx, 0);
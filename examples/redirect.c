@@ -3,13 +3,13 @@
  * The problem is non-trivial since Linux epoll, which libuEv uses, does
  * not support I/O watchers for regular files or directories.
  *
- * This works:
+ * Both of these work:
  *                  echo foo | redirect
- * This doesn't:
  *                  redirect < foo.txt
  *
- * However, with a little bit of hacking libuEv can be made to handle
- * reading from stdin as a special case.
+ * A regular file is always readable, so libuEv calls a read watcher for
+ * it from the ready queue, each loop iteration, until end of file.  For
+ * large files, see the file reader watcher, uev_file_init().
  */
 
 #include <err.h>
@@ -0,0 +1,174 @@
+/* Example of per-watcher profiling, like top(1) for watchers
+ *
+ * Sets up a number of connections, each with a different cost per
+ * event, and a feeder timer that writes to them.  Every second the
+ * most costly watchers are listed, by CPU time spent in callbacks:
+ *
+ *                  top -n 5 -s 3
+ *
+ * In a real daemon the dump is better done on demand, e.g., from a
+ * signal watcher on SIGUSR1, see uev_profile_set().
+ */
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "src/uev.h"
+
+#define CONNS     8
+#define MAXSTAT   64
+
+static uev_t conn[CONNS];
+static int   peer[CONNS];
+static int   ntop = 5;
+static int   secs = 3;
+
+/* Pretend work, connection i costs (CONNS - i) * 10 usec per event */
+static void work(int i)
+{
+	struct timespec ts;
+	uint64_t start, now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	do {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	} while (now - start < (CONNS - i) * 10000ULL);
+}
+
+static void reader(uev_t *w, void *arg, int events)
+{
+	char buf[64];
+
+	if (read(w->fd, buf, sizeof(buf)) < 0) {
+		if (errno == EAGAIN)
+			uev_stat_spurious(w);
+		return;
+	}
+
+	work((int)(long)arg);
+}
+
+/* Every connection gets a message every millisecond */
+static void feeder(uev_t *w, void *arg, int events)
+{
+	int i;
+
+	for (i = 0; i < CONNS; i++) {
+		if (write(peer[i], "x", 1) != 1)
+			warn("Failed writing to connection %d", i);
+	}
+}
+
+static int bycpu(const void *a, const void *b)
+{
+	const struct uev_stat *x = a, *y = b;
+
+	if (x->cpu == y->cpu)
+		return 0;
+
+	return x->cpu < y->cpu ? 1 : -1;
+}
+
+/* Dump the most costly watchers, by CPU time */
+static void top(uev_ctx_t *ctx, int n)
+{
+	struct uev_stat st[MAXSTAT], tmp;
+	uint64_t now = uev_now(ctx);
+	int i, num = 0;
+	uev_t *w;
+
+	for (w = uev_stat_next(ctx, NULL, &tmp); w; w = uev_stat_next(ctx, w, &tmp)) {
+		if (num < MAXSTAT)
+			st[num++] = tmp;
+	}
+	qsort(st, num, sizeof(st[0]), bycpu);
+
+	printf("%-8s %4s %8s %10s %8s %9s %8s\n", "TYPE", "FD", "CALLS",
+	       "CPU ms", "AVG us", "IDLE ms", "SPURIOUS");
+	for (i = 0; i < num && i < n; i++) {
+		printf("%-8s %4d %8llu %10.2f %8.1f %9.1f %8llu\n", st[i].type, st[i].fd,
+		       (unsigned long long)st[i].count, st[i].cpu / 1e6,
+		       st[i].count ? st[i].cpu / 1e3 / st[i].count : 0.0,
+		       st[i].last ? (now - st[i].last) / 1e6 : 0.0,
+		       (unsigned long long)st[i].spurious);
+	}
+	puts("");
+}
+
+static void report(uev_t *w, void *arg, int events)
+{
+	top(w->ctx, ntop);
+	if (--secs <= 0)
+		uev_exit(w->ctx);
+}
+
+static int usage(int rc)
+{
+	fprintf(stderr,
+		"Usage: top [-h] [-n NUM] [-s SEC]\n"
+		"\n"
+		"  -h      This help text\n"
+		"  -n NUM  Number of watchers to list, default: 5\n"
+		"  -s SEC  Seconds to run, one report per second, default: 3\n");
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	uev_t feed, rep;
+	uev_ctx_t ctx;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "hn:s:")) != -1) {
+		switch (c) {
+		case 'h':
+			return usage(0);
+		case 'n':
+			ntop = atoi(optarg);
+			break;
+		case 's':
+			secs = atoi(optarg);
+			break;
+		default:
+			return usage(1);
+		}
+	}
+
+	if (uev_init(&ctx))
+		err(1, "Failed creating event context");
+	uev_profile_set(&ctx, 1);
+
+	for (i = 0; i < CONNS; i++) {
+		int sv[2];
+
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv))
+			err(1, "Failed creating connection");
+		peer[i] = sv[1];
+
+		if (uev_io_init(&ctx, &conn[i], reader, (void *)(long)i, sv[0], UEV_READ))
+			err(1, "Failed setting up connection watcher");
+	}
+
+	if (uev_timer_init(&ctx, &feed, feeder, NULL, 1, 1) ||
+	    uev_timer_init(&ctx, &rep, report, NULL, 1000, 1000))
+		err(1, "Failed setting up timers");
+
+	return uev_run(&ctx, 0);
+}
+
+/**
+ * Local Variables:
+ *  compile-command: "make top; ./top"
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Generate a single-file libuEv, uev_amalgamated.c and uev_amalgamated.h
+#
+# Usage: amalgamate.sh SRCDIR FILE...
+#
+# The header is uev_conf.h, from the build directory, private.h and
+# uev.h.  The source file is all .c files in FILE..., i.e., the library
+# sources selected by configure, with their libuEv #includes removed.
+# Other files, e.g., headers, are skipped.
+set -e
+
+srcdir=$1
+shift
+
+hdr=uev_amalgamated.h
+src=uev_amalgamated.c
+
+# Drop includes of our own headers, all in the amalgamated header
+strip()
+{
+	sed -e '/^#include "uev_conf.h"/d'	\
+	    -e '/^#include "private.h"/d'	\
+	    -e '/^#include "uev.h"/d' "$1"
+}
+
+{
+	echo "/* libuEv $PACKAGE_VERSION, amalgamated header, generated by amalgamate.sh */"
+	echo
+	for file in uev_conf.h "$srcdir/private.h" "$srcdir/uev.h"; do
+		echo "/*** $(basename "$file") ***/"
+		strip "$file"
+	done
+} > "$hdr.tmp"
+
+{
+	echo "/* libuEv $PACKAGE_VERSION, amalgamated source, generated by amalgamate.sh"
+	echo " *"
+	echo " * Build with the application, e.g., cc -O2 -flto app.c $src"
+	echo " * Define HAVE_EPOLL_PWAIT2 for nanosecond timeouts on Linux >= 5.11"
+	echo " */"
+	echo "#ifndef _GNU_SOURCE"
+	echo "#define _GNU_SOURCE"
+	echo "#endif"
+	echo
+	echo "#include \"$hdr\""
+	for file in "$@"; do
+		case $file in
+		*.c)	;;
+		*)	continue ;;
+		esac
+		echo
+		echo "/*** $file ***/"
+		strip "$srcdir/$file" | sed -e '/^#ifdef HAVE_CONFIG_H/,/^#endif/d'
+	done
+} > "$src.tmp"
+
+mv "$hdr.tmp" "$hdr"
+mv "$src.tmp" "$src"
@@ -34,6 +34,9 @@
  *
  *     Adaptations for libuEv, no libev/libevent API wrappers available.
  *     Reindent to Linux coding style
+ *
+ *     Optional hardware performance counters, -p, using perf_event_open()
+ *     around the measured region, reported per dispatched event.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -48,7 +51,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
 #include <sys/resource.h>
+#include <sys/syscall.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -68,6 +74,119 @@ static int *pipes;
 static uev_t *evio;
 static uev_t *evto;
 
+#define L1D_READ_MISS (PERF_COUNT_HW_CACHE_L1D |			\
+		       (PERF_COUNT_HW_CACHE_OP_READ << 8) |		\
+		       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static int perf;
+static struct counter {
+	const char *name;
+	uint32_t    type;
+	uint64_t    config;
+	int         fd;
+	int         user;	/* Kernel not counted, perf_event_paranoid */
+	double      val;
+} counters[] = {
+	{ "cycles",        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,          -1, 0, 0 },
+	{ "instructions",  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,        -1, 0, 0 },
+	{ "l1d-misses",    PERF_TYPE_HW_CACHE, L1D_READ_MISS,                     -1, 0, 0 },
+	{ "llc-misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,        -1, 0, 0 },
+	{ "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,       -1, 0, 0 },
+	{ "ctx-switches",  PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES,    -1, 0, 0 },
+};
+#define NUM_COUNTERS (int)(sizeof(counters) / sizeof(counters[0]))
+
+/*
+ * Open counters for this thread, first including the kernel, e.g., the
+ * cost of epoll_wait(), and if not permitted, user space only.  Any
+ * counter the CPU, or a VM, lacks is skipped.
+ */
+static int perf_open(void)
+{
+	struct perf_event_attr attr;
+	int i, num = 0, err = 0;
+
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		struct counter *c = &counters[i];
+
+		memset(&attr, 0, sizeof(attr));
+		attr.size        = sizeof(attr);
+		attr.type        = c->type;
+		attr.config      = c->config;
+		attr.disabled    = 1;
+		attr.exclude_hv  = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+		c->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+		if (c->fd < 0 && (errno == EACCES || errno == EPERM)) {
+			attr.exclude_kernel = 1;
+			c->fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+			c->user = 1;
+		}
+		if (c->fd < 0) {
+			err = errno;
+			continue;
+		}
+		num++;
+	}
+
+	if (!num) {
+		fprintf(stderr, "No performance counters available: %s\n"
+			"Check /proc/sys/kernel/perf_event_paranoid\n", strerror(err));
+		return -1;
+	}
+
+	return 0;
+}
+
+static void perf_start(void)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		if (counters[i].fd < 0)
+			continue;
+		ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+}
+
+/* Read counters, scaled if multiplexed with other counters */
+static void perf_stop(void)
+{
+	uint64_t val[3];	/* value, time enabled, time running */
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		struct counter *c = &counters[i];
+
+		if (c->fd < 0)
+			continue;
+
+		ioctl(c->fd, PERF_EVENT_IOC_DISABLE, 0);
+		if (read(c->fd, val, sizeof(val)) != sizeof(val) || !val[2]) {
+			c->val = -1;
+			continue;
+		}
+		c->val = (double)val[0] * val[1] / val[2];
+	}
+}
+
+static void perf_print(int events)
+{
+	int i;
+
+	for (i = 0; i < NUM_COUNTERS; i++) {
+		struct counter *c = &counters[i];
+
+		if (c->fd < 0 || c->val < 0 || !events)
+			fprintf(stdout, "# %-14s %10s\n", c->name, "n/a");
+		else
+			fprintf(stdout, "# %-14s %10.1f /event%s\n", c->name,
+				c->val / events, c->user ? ", user only" : "");
+	}
+}
+
 static void read_cb(uev_t *w, void *arg, int events)
 {
 	int idx, widx;
@@ -130,12 +249,16 @@ static struct timeval *run_once(uev_ctx_t *ctx)
 		int xcount = 0;
 
 		gettimeofday(&ts, NULL);
+		if (perf)
+			perf_start();
 
 		do {
 			uev_run(ctx, UEV_ONCE | UEV_NONBLOCK);
 			xcount++;
 		} while (count != fired);
 
+		if (perf)
+			perf_stop();
 		gettimeofday(&te, NULL);
 
 		if (xcount != count)
@@ -147,6 +270,8 @@ static struct timeval *run_once(uev_ctx_t *ctx)
 	fprintf(stdout, "%8ld %8ld\n",
 		ta.tv_sec * 1000000L + ta.tv_usec,
 		ts.tv_sec * 1000000L + ts.tv_usec);
+	if (perf)
+		perf_print(count);
 
 	return &te;
 }
@@ -162,7 +287,7 @@ int main(int argc, char **argv)
 	num_pipes = 100;
 	num_active = 1;
 	num_writes = num_pipes;
-	while ((c = getopt(argc, argv, "a:n:tw:")) != -1) {
+	while ((c = getopt(argc, argv, "a:n:ptw:")) != -1) {
 		switch (c) {
 		case 'a':
 			num_active = atoi(optarg);
@@ -172,6 +297,10 @@ int main(int argc, char **argv)
 			num_pipes = atoi(optarg);
 			break;
 
+		case 'p':
+			perf = 1;
+			break;
+
 		case 't':
 			timers = 1;
 			break;
@@ -201,6 +330,9 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (perf && perf_open())
+		perf = 0;
+
 	uev_init(&ctx);
 
 	for (cp = pipes, i = 0; i < num_pipes; i++, cp += 2) {
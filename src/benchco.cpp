@@ -0,0 +1,221 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Echo throughput, C++20 coroutines, uev_coro.hpp, compared to plain
+ * callbacks, uev.hpp.  N socket pairs, the client end of each sends a
+ * message and waits for the echo before sending the next one.  Also
+ * counts heap allocations while running, there should be none with
+ * coroutine frames from the Loop's pool.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "uev_coro.hpp"
+
+using namespace libuev;
+
+static int num_conns = 100, num_msgs = 200000;
+static int sent, received;
+static size_t allocs;
+
+void *operator new(size_t size)
+{
+	void *ptr = malloc(size);
+
+	if (!ptr)
+		throw std::bad_alloc();
+	allocs++;
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+static uint64_t now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+struct client;
+static std::vector<client> *clients;
+
+/* Client end, same for both */
+struct client {
+	Io io;
+
+	void send()
+	{
+		if (sent >= num_msgs)
+			return;
+		sent++;
+		if (write(io.fd(), "hello, world", 12) != 12)
+			abort();
+	}
+
+	void on_read(Io &w, int events)
+	{
+		char buf[64];
+
+		if (read(w.fd(), buf, sizeof(buf)) <= 0)
+			return;
+		if (++received == num_msgs)
+			done();
+		else
+			send();
+	}
+
+	/* Hang up, servers see EOF, loop ends with the last watcher */
+	static void done()
+	{
+		for (auto &cl : *clients) {
+			shutdown(cl.io.fd(), SHUT_WR);
+			cl.io.stop();
+		}
+	}
+};
+
+/* Server end, callback style */
+struct server {
+	Io io;
+
+	void on_read(Io &w, int events)
+	{
+		char buf[64];
+		ssize_t len;
+
+		len = read(w.fd(), buf, sizeof(buf));
+		if (len == 0)
+			w.stop();
+		else if (len > 0 && write(w.fd(), buf, len) != len)
+			abort();
+	}
+};
+
+/* Server end, coroutine style */
+static Task session(Loop &loop, int sd)
+{
+	char buf[64];
+	ssize_t len;
+	Io rd;
+
+	for (;;) {
+		len = read(sd, buf, sizeof(buf));
+		if (len < 0) {
+			if (co_await readable(loop, rd, sd) != UEV_READ)
+				break;
+			continue;
+		}
+		if (len == 0 || write(sd, buf, len) != len)
+			break;
+	}
+}
+
+static void run(const char *name, bool coro)
+{
+	std::vector<client> c(num_conns);
+	std::vector<server> s(num_conns);
+	std::vector<int> fds(2 * num_conns);
+	uint64_t start, elapsed;
+	size_t before;
+	Loop loop;
+
+	clients = &c;
+	sent = received = 0;
+	for (int i = 0; i < num_conns; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[2 * i]))
+			abort();
+
+		c[i].io.start<&client::on_read>(loop, &c[i], fds[2 * i], UEV_READ);
+		if (coro)
+			session(loop, fds[2 * i + 1]);
+		else
+			s[i].io.start<&server::on_read>(loop, &s[i], fds[2 * i + 1], UEV_READ);
+	}
+
+	before = allocs;
+	start  = now();
+	for (auto &cl : c)
+		cl.send();
+	loop.run();
+	elapsed = now() - start;
+
+	printf("%-10s %8.1f ns/msg %10.0f msg/s %6zu allocs\n", name,
+	       (double)elapsed / num_msgs, num_msgs * 1e9 / elapsed, allocs - before);
+
+	for (int fd : fds)
+		close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "c:n:")) != -1) {
+		switch (opt) {
+		case 'c':
+			num_conns = atoi(optarg);
+			break;
+
+		case 'n':
+			num_msgs = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: benchco [-c CONNS] [-n MSGS]\n");
+			return 1;
+		}
+	}
+
+	run("callback", false);
+	run("coroutine", true);
+	run("callback", false);
+	run("coroutine", true);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
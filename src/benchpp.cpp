@@ -0,0 +1,203 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Callback overhead of the C++ wrapper, uev.hpp, compared to the raw C
+ * API.  Same chain propagation as bench.c: a byte written to the first
+ * of N socket pairs is read by its watcher, which writes a byte to the
+ * next one, until all writes are done.  Reports the best time per
+ * event of a number of rounds for each API.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+#include "uev.hpp"
+
+static int num_pipes = 100, num_writes = 100000, rounds = 5;
+static std::vector<int> fds;
+static int writes;
+
+static uint64_t now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void relay(int idx)
+{
+	if (writes-- <= 0)
+		return;
+
+	if (++idx >= num_pipes)
+		idx = 0;
+	if (write(fds[2 * idx + 1], "e", 1) != 1)
+		abort();
+}
+
+/* Raw C API, with per-watcher state passed in arg */
+struct cnode {
+	uev_t w;
+	int   idx;
+};
+
+static void c_cb(uev_t *w, void *arg, int events)
+{
+	cnode *n = static_cast<cnode *>(arg);
+	char ch;
+
+	if (read(w->fd, &ch, 1) == 1)
+		relay(n->idx);
+}
+
+/* C++ wrapper, member function bound at compile time */
+struct node {
+	libuev::Io io;
+	int     idx;
+
+	void on_read(libuev::Io &w, int events)
+	{
+		char ch;
+
+		if (read(w.fd(), &ch, 1) == 1)
+			relay(idx);
+	}
+};
+
+static uint64_t drain(uev_ctx_t *ctx)
+{
+	uint64_t start = now();
+
+	writes = num_writes;
+	relay(-1);
+	while (writes > 0)
+		uev_run(ctx, UEV_ONCE);
+
+	/* Last byte in flight */
+	uev_run(ctx, UEV_ONCE);
+
+	return now() - start;
+}
+
+static uint64_t run_c()
+{
+	std::vector<cnode> n(num_pipes);
+	uint64_t best = ~0ULL;
+	uev_ctx_t ctx;
+
+	uev_init(&ctx);
+	for (int i = 0; i < num_pipes; i++) {
+		n[i].idx = i;
+		uev_io_init(&ctx, &n[i].w, c_cb, &n[i], fds[2 * i], UEV_READ);
+	}
+
+	for (int r = 0; r < rounds; r++) {
+		uint64_t t = drain(&ctx);
+
+		if (t < best)
+			best = t;
+	}
+	uev_exit(&ctx);
+
+	return best;
+}
+
+static uint64_t run_cxx()
+{
+	std::vector<node> n(num_pipes);
+	uint64_t best = ~0ULL;
+	libuev::Loop loop;
+
+	for (int i = 0; i < num_pipes; i++) {
+		n[i].idx = i;
+		n[i].io.start<&node::on_read>(loop, &n[i], fds[2 * i], UEV_READ);
+	}
+
+	for (int r = 0; r < rounds; r++) {
+		uint64_t t = drain(loop.native());
+
+		if (t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	uint64_t c, cxx;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:w:")) != -1) {
+		switch (opt) {
+		case 'n':
+			num_pipes = atoi(optarg);
+			break;
+
+		case 'r':
+			rounds = atoi(optarg);
+			break;
+
+		case 'w':
+			num_writes = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, "Usage: benchpp [-n PIPES] [-r ROUNDS] [-w WRITES]\n");
+			return 1;
+		}
+	}
+
+	fds.resize(2 * num_pipes);
+	for (int i = 0; i < num_pipes; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, &fds[2 * i])) {
+			perror("socketpair");
+			return 1;
+		}
+	}
+
+	/* Interleave, and repeat, to even out CPU frequency effects */
+	c   = run_c();
+	cxx = run_cxx();
+	c   = std::min(c, run_c());
+	cxx = std::min(cxx, run_cxx());
+
+	printf("C API   %8.1f ns/event\n", (double)c / num_writes);
+	printf("C++ API %8.1f ns/event\n", (double)cxx / num_writes);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
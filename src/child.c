@@ -0,0 +1,147 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2012       Flemming Madsen <flemming!madsen()madsensoft!dk>
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>		/* memset() */
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>		/* close(), syscall() */
+
+#include "uev.h"
+
+/* Missing defines in GLIBC <= 2.35 */
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+
+/**
+ * Child process watcher, Linux [pidfd_open(2)](https://man7.org/linux/man-pages/man2/pidfd_open.2.html)
+ * @file child.c
+ *
+ * The exit status of the child is available to the callback in
+ * uev::siginfo, same as for a SIGCHLD signal watcher: `ssi_pid`,
+ * `ssi_uid`, `ssi_code` (`CLD_EXITED`, `CLD_KILLED`, or `CLD_DUMPED`),
+ * and `ssi_status`.
+ */
+
+/**
+ * Create and start a child process watcher
+ * @param ctx    A valid libuEv context
+ * @param w      Pointer to an uev_t watcher
+ * @param cb     Callback when the child process exits
+ * @param arg    Optional callback argument
+ * @param pid    Child process to watch
+ *
+ * The child is reaped by libuEv, using `waitid(P_PIDFD)`, before the
+ * callback is called.  Unlike a SIGCHLD signal watcher with a waitpid()
+ * loop, this costs O(1) per child and does not race with any other
+ * SIGCHLD handling in the application.  Requires Linux 5.4, or later.
+ *
+ * The watcher is stopped when the child has been reaped.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_child_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, pid_t pid)
+{
+	int fd;
+
+	if (!w || !ctx || pid <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	w->fd = -1;
+
+	fd = syscall(SYS_pidfd_open, pid, 0);
+	if (fd < 0)
+		return -1;
+
+	if (_uev_watcher_init(ctx, w, UEV_CHILD_TYPE, cb, arg, fd, UEV_READ))
+		goto exit;
+	w->u.p.pid = pid;
+
+	if (_uev_watcher_start(w)) {
+	exit:
+		close(fd);
+		w->fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Stop a child process watcher
+ * @param w  Watcher to stop
+ *
+ * The child process is not reaped, use waitpid() if required.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_child_stop(uev_t *w)
+{
+	if (!_uev_watcher_active(w))
+		return 0;
+
+	if (_uev_watcher_stop(w))
+		return -1;
+
+	close(w->fd);
+	w->fd = -1;
+
+	return 0;
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_child_reap(uev_t *w)
+{
+	siginfo_t info;
+
+	info.si_pid = 0;
+	if (waitid(P_PIDFD, w->fd, &info, WEXITED | WNOHANG) < 0)
+		return -1;
+
+	/* Not exited yet, spurious wakeup */
+	if (info.si_pid == 0)
+		return 1;
+
+	memset(&w->siginfo, 0, sizeof(w->siginfo));
+	w->siginfo.ssi_signo  = SIGCHLD;
+	w->siginfo.ssi_code   = info.si_code;
+	w->siginfo.ssi_pid    = info.si_pid;
+	w->siginfo.ssi_uid    = info.si_uid;
+	w->siginfo.ssi_status = info.si_status;
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
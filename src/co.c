@@ -0,0 +1,563 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2012       Flemming Madsen <flemming!madsen()madsensoft!dk>
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stddef.h>		/* offsetof() */
+#include <stdint.h>
+#include <sys/mman.h>		/* mmap(), mprotect(), munmap() */
+#include <unistd.h>		/* read(), write(), sysconf() */
+
+#include "uev.h"
+
+/* Usable stack per coroutine, excluding guard page */
+#ifndef UEV_CO_STACK_SIZE
+#define UEV_CO_STACK_SIZE (64 * 1024)
+#endif
+
+/* Max number of unused stacks kept per context */
+#ifndef UEV_CO_POOL_SIZE
+#define UEV_CO_POOL_SIZE  64
+#endif
+
+/*
+ * Shadow stacks (CET) do not allow switching stacks behind the back of
+ * the CPU, use the ucontext fallback for such builds.
+ */
+#if defined(__CET__) && (__CET__ & 2)
+#define CO_UCONTEXT
+#elif !defined(__x86_64__) && !defined(__aarch64__)
+#define CO_UCONTEXT
+#endif
+
+#ifdef CO_UCONTEXT
+#include <ucontext.h>
+#endif
+
+/**
+ * Stackful coroutines
+ * @file co.c
+ *
+ * Each coroutine runs on its own small stack, mmap()ed with a guard
+ * page below, drawn from a per-context pool.  The blocking-style
+ * primitives start an I/O, timer, or event watcher and switch back to
+ * the event loop, the watcher's callback switches to the coroutine
+ * again.  On x86_64 and aarch64 a switch only saves the callee-saved
+ * registers and swaps stack pointers, no system calls.
+ */
+
+struct uev_co {
+	uev_ctx_t      *ctx;
+	struct uev_co  *next, *prev;
+
+#ifdef CO_UCONTEXT
+	ucontext_t      uc, caller;
+#else
+	void           *sp, *caller;
+#endif
+
+	uev_co_fn_t    *fn;
+	void           *arg;
+	int             running;
+	int             done;
+
+	/* Internal watchers, and the one we are waiting for */
+	uev_t           io, timer;
+	uev_t          *wait;
+	int             events;
+};
+
+#ifndef CO_UCONTEXT
+#define CO_HIDDEN __attribute__((visibility("hidden")))
+
+CO_HIDDEN void _uev_co_switch(void **from, void *to);
+CO_HIDDEN void _uev_co_start(void);
+/* Only called from asm, so must be kept also with -flto */
+CO_HIDDEN void _uev_co_main(struct uev_co *co) __attribute__((noreturn, used));
+
+#if defined(__x86_64__)
+__asm__(
+	".text\n"
+	".globl _uev_co_switch\n"
+	".hidden _uev_co_switch\n"
+	".type _uev_co_switch,@function\n"
+	"_uev_co_switch:\n"
+	"	endbr64\n"
+	"	pushq %rbp\n"
+	"	pushq %rbx\n"
+	"	pushq %r12\n"
+	"	pushq %r13\n"
+	"	pushq %r14\n"
+	"	pushq %r15\n"
+	"	movq %rsp, (%rdi)\n"
+	"	movq %rsi, %rsp\n"
+	"	popq %r15\n"
+	"	popq %r14\n"
+	"	popq %r13\n"
+	"	popq %r12\n"
+	"	popq %rbx\n"
+	"	popq %rbp\n"
+	"	ret\n"
+	".size _uev_co_switch,.-_uev_co_switch\n"
+	"\n"
+	".globl _uev_co_start\n"
+	".hidden _uev_co_start\n"
+	".type _uev_co_start,@function\n"
+	"_uev_co_start:\n"
+	"	movq %rbx, %rdi\n"
+	"	call _uev_co_main\n"
+	"	ud2\n"
+	".size _uev_co_start,.-_uev_co_start\n"
+);
+
+/* Initial frame popped by _uev_co_switch(): r15-r12, rbx, rbp, ret */
+enum { CO_RBX = 4, CO_RET = 6, CO_FRAME = 9 };
+#elif defined(__aarch64__)
+__asm__(
+	".text\n"
+	".globl _uev_co_switch\n"
+	".hidden _uev_co_switch\n"
+	".type _uev_co_switch,%function\n"
+	"_uev_co_switch:\n"
+	"	hint #34\n"
+	"	sub sp, sp, #160\n"
+	"	stp x19, x20, [sp, #0]\n"
+	"	stp x21, x22, [sp, #16]\n"
+	"	stp x23, x24, [sp, #32]\n"
+	"	stp x25, x26, [sp, #48]\n"
+	"	stp x27, x28, [sp, #64]\n"
+	"	stp x29, x30, [sp, #80]\n"
+	"	stp d8,  d9,  [sp, #96]\n"
+	"	stp d10, d11, [sp, #112]\n"
+	"	stp d12, d13, [sp, #128]\n"
+	"	stp d14, d15, [sp, #144]\n"
+	"	mov x2, sp\n"
+	"	str x2, [x0]\n"
+	"	mov sp, x1\n"
+	"	ldp x19, x20, [sp, #0]\n"
+	"	ldp x21, x22, [sp, #16]\n"
+	"	ldp x23, x24, [sp, #32]\n"
+	"	ldp x25, x26, [sp, #48]\n"
+	"	ldp x27, x28, [sp, #64]\n"
+	"	ldp x29, x30, [sp, #80]\n"
+	"	ldp d8,  d9,  [sp, #96]\n"
+	"	ldp d10, d11, [sp, #112]\n"
+	"	ldp d12, d13, [sp, #128]\n"
+	"	ldp d14, d15, [sp, #144]\n"
+	"	add sp, sp, #160\n"
+	"	ret\n"
+	".size _uev_co_switch,.-_uev_co_switch\n"
+	"\n"
+	".globl _uev_co_start\n"
+	".hidden _uev_co_start\n"
+	".type _uev_co_start,%function\n"
+	"_uev_co_start:\n"
+	"	mov x0, x19\n"
+	"	bl _uev_co_main\n"
+	"	brk #0\n"
+	".size _uev_co_start,.-_uev_co_start\n"
+);
+
+/* Initial frame popped by _uev_co_switch(): x19, ..., x30 (lr), d8-d15 */
+enum { CO_RBX = 0, CO_RET = 11, CO_FRAME = 20 };
+#endif
+#endif /* !CO_UCONTEXT */
+
+/* Switch from caller, event loop or other coroutine, to coroutine */
+static void co_resume(struct uev_co *co)
+{
+	co->running = 1;
+#ifdef CO_UCONTEXT
+	swapcontext(&co->caller, &co->uc);
+#else
+	_uev_co_switch(&co->caller, co->sp);
+#endif
+	co->running = 0;
+}
+
+/* Switch from coroutine back to whoever resumed it */
+static void co_yield(struct uev_co *co)
+{
+#ifdef CO_UCONTEXT
+	swapcontext(&co->uc, &co->caller);
+#else
+	_uev_co_switch(&co->sp, co->caller);
+#endif
+}
+
+static size_t co_pagesz(void)
+{
+	static size_t pagesz;
+
+	if (!pagesz)
+		pagesz = sysconf(_SC_PAGESIZE);
+
+	return pagesz;
+}
+
+/* Total mapping, control block at the top and guard page at the bottom */
+static size_t co_mapsz(void)
+{
+	size_t pagesz = co_pagesz();
+
+	return pagesz + ((UEV_CO_STACK_SIZE + sizeof(struct uev_co) + pagesz - 1) & ~(pagesz - 1));
+}
+
+static void *co_base(struct uev_co *co)
+{
+	return (char *)co + sizeof(struct uev_co) - co_mapsz();
+}
+
+static struct uev_co *co_alloc(uev_ctx_t *ctx)
+{
+	struct uev_co *co;
+	size_t mapsz;
+	char *base;
+
+	co = ctx->co_pool;
+	if (co) {
+		_UEV_REMOVE(co, ctx->co_pool);
+		ctx->co_pooled--;
+		return co;
+	}
+
+	mapsz = co_mapsz();
+	base = mmap(NULL, mapsz, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+	if (base == MAP_FAILED)
+		return NULL;
+
+	/* Stack overflow faults instead of corrupting the neighbour */
+	if (mprotect(base, co_pagesz(), PROT_NONE)) {
+		munmap(base, mapsz);
+		return NULL;
+	}
+
+	co = (struct uev_co *)(base + mapsz - sizeof(struct uev_co));
+	co->next = co->prev = NULL;
+
+	return co;
+}
+
+/* Return stack to pool, or unmap if the pool is full or context exited */
+static void co_free(struct uev_co *co)
+{
+	uev_ctx_t *ctx = co->ctx;
+
+	_UEV_REMOVE(co, ctx->co);
+	if (ctx->fd > -1 && ctx->co_pooled < UEV_CO_POOL_SIZE) {
+		_UEV_INSERT(co, ctx->co_pool);
+		ctx->co_pooled++;
+		return;
+	}
+
+	munmap(co_base(co), co_mapsz());
+}
+
+#ifdef CO_UCONTEXT
+static void co_main_uc(unsigned int hi, unsigned int lo)
+{
+	struct uev_co *co = (struct uev_co *)(((uintptr_t)hi << 16 << 16) | lo);
+#else
+void _uev_co_main(struct uev_co *co)
+{
+#endif
+	co->fn(co, co->arg);
+
+	/* Release watchers, stack is released by resumer */
+	uev_io_stop(&co->io);
+	uev_timer_stop(&co->timer);
+	co->done = 1;
+
+	co_yield(co);
+	__builtin_unreachable();
+}
+
+/* Resume coroutine from its watcher's callback */
+static void co_wake(uev_t *w, void *arg, int events)
+{
+	struct uev_co *co = (struct uev_co *)arg;
+
+	/* Spurious, e.g. shared descriptor without one-shot */
+	if (co->wait != w) {
+		if (w == &co->io)
+			uev_io_stop(w);
+		return;
+	}
+
+	co->wait   = NULL;
+	co->events = events;
+	co_resume(co);
+
+	if (co->done)
+		co_free(co);
+}
+
+/* Switch back to the event loop until watcher @w fires */
+static int co_wait(struct uev_co *co, uev_t *w)
+{
+	co->wait = w;
+	co_yield(co);
+
+	return co->events;
+}
+
+/* Wait for fd, the I/O watcher stays registered, rearmed in one call */
+static int co_io(struct uev_co *co, int fd, int events)
+{
+	uev_t *w = &co->io;
+
+	events |= UEV_ONESHOT;
+	if (uev_io_active(w) && (w->fd != fd || w->events != events))
+		uev_io_stop(w);
+
+	if (uev_io_active(w)) {
+		if (uev_io_set(w, fd, events))
+			return -1;
+	} else if (uev_io_init(co->ctx, w, co_wake, co, fd, events))
+		return -1;
+
+	return co_wait(co, w);
+}
+
+/**
+ * Create and start a coroutine
+ * @param ctx    A valid libuEv context
+ * @param fn     Coroutine function
+ * @param arg    Optional argument to @p fn
+ *
+ * The coroutine runs immediately, until it returns or waits in one of
+ * the uev_co_read(), uev_co_write(), uev_co_sleep(), or
+ * uev_co_wait_event() primitives, after which this function returns.
+ * The event loop resumes the coroutine when what it waits for is ready,
+ * and its stack is returned to the pool when @p fn returns.
+ *
+ * The stack is UEV_CO_STACK_SIZE bytes, 64 kiB by default, with a guard
+ * page below it.  Avoid large local variables in coroutines.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_co_spawn(uev_ctx_t *ctx, uev_co_fn_t *fn, void *arg)
+{
+	struct uev_co *co;
+
+	if (!ctx || !fn || ctx->fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	co = co_alloc(ctx);
+	if (!co)
+		return -1;
+
+	co->ctx    = ctx;
+	co->fn     = fn;
+	co->arg    = arg;
+	co->done   = 0;
+	co->wait   = NULL;
+	co->events = 0;
+	_uev_watcher_init(ctx, &co->io, UEV_IO_TYPE, co_wake, co, -1, 0);
+	_uev_watcher_init(ctx, &co->timer, UEV_TIMER_TYPE, co_wake, co, -1, 0);
+	_UEV_INSERT(co, ctx->co);
+
+#ifdef CO_UCONTEXT
+	getcontext(&co->uc);
+	co->uc.uc_stack.ss_sp   = (char *)co_base(co) + co_pagesz();
+	co->uc.uc_stack.ss_size = (char *)co - (char *)co->uc.uc_stack.ss_sp;
+	co->uc.uc_link          = NULL;
+	makecontext(&co->uc, (void (*)(void))co_main_uc, 2,
+		    (unsigned int)((uintptr_t)co >> 16 >> 16), (unsigned int)(uintptr_t)co);
+#else
+	{
+		void **sp = (void **)((uintptr_t)co & ~(uintptr_t)15) - CO_FRAME;
+		int i;
+
+		for (i = 0; i < CO_FRAME; i++)
+			sp[i] = NULL;
+		sp[CO_RBX] = co;
+		sp[CO_RET] = (void *)_uev_co_start;
+		co->sp = sp;
+	}
+#endif
+
+	co_resume(co);
+	if (co->done)
+		co_free(co);
+
+	return 0;
+}
+
+/**
+ * Read from a descriptor, waiting in the event loop if needed
+ * @param co   Current coroutine
+ * @param fd   Non-blocking descriptor to read from
+ * @param buf  Buffer to read into
+ * @param len  Size of @p buf
+ *
+ * @return Same as read(2), but never fails with EAGAIN.
+ */
+ssize_t uev_co_read(uev_co_t *co, int fd, void *buf, size_t len)
+{
+	ssize_t num;
+
+	if (!co) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while ((num = read(fd, buf, len)) < 0) {
+		if (errno == EINTR)
+			continue;
+		if (errno != EAGAIN && errno != EWOULDBLOCK)
+			return -1;
+		if (co_io(co, fd, UEV_READ) < 0)
+			return -1;
+	}
+
+	return num;
+}
+
+/**
+ * Write to a descriptor, waiting in the event loop if needed
+ * @param co   Current coroutine
+ * @param fd   Non-blocking descriptor to write to
+ * @param buf  Data to write
+ * @param len  Length of @p buf
+ *
+ * Unlike write(2), all of @p buf is written before returning.
+ *
+ * @return Number of bytes written, or -1 with @p errno set if nothing
+ * could be written.
+ */
+ssize_t uev_co_write(uev_co_t *co, int fd, const void *buf, size_t len)
+{
+	const char *ptr = buf;
+	size_t done = 0;
+	ssize_t num;
+
+	if (!co) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (done < len) {
+		num = write(fd, ptr + done, len - done);
+		if (num < 0) {
+			if (errno == EINTR)
+				continue;
+			if ((errno != EAGAIN && errno != EWOULDBLOCK) ||
+			    co_io(co, fd, UEV_WRITE) < 0)
+				return done ? (ssize_t)done : -1;
+			continue;
+		}
+		done += num;
+	}
+
+	return done;
+}
+
+/**
+ * Sleep in the event loop
+ * @param co    Current coroutine
+ * @param msec  Time to sleep, in milliseconds
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_co_sleep(uev_co_t *co, int msec)
+{
+	if (!co || msec <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (uev_timer_init(co->ctx, &co->timer, co_wake, co, msec, 0))
+		return -1;
+
+	return co_wait(co, &co->timer) & UEV_ERROR ? -1 : 0;
+}
+
+/**
+ * Wait for an event watcher to be posted
+ * @param co  Current coroutine
+ * @param w   Event watcher, see uev_event_init()
+ *
+ * The watcher's callback is replaced while waiting, the coroutine is
+ * resumed instead.  Only one coroutine can wait for the same watcher.
+ * Useful for waking up a coroutine from another thread with
+ * uev_event_post().
+ *
+ * @return The event mask, ::UEV_READ, or ::UEV_HUP on error.
+ */
+int uev_co_wait_event(uev_co_t *co, uev_t *w)
+{
+	void (*cb)(uev_t *, void *, int);
+	void *arg;
+	int events;
+
+	if (!co || !w || w->type != UEV_EVENT_TYPE || !_uev_watcher_active(w)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	cb  = w->cb;
+	arg = w->arg;
+	w->cb  = co_wake;
+	w->arg = co;
+
+	events = co_wait(co, w);
+
+	w->cb  = cb;
+	w->arg = arg;
+
+	return events;
+}
+
+/* Private to libuEv, do not use directly! */
+void _uev_co_exit(uev_ctx_t *ctx)
+{
+	struct uev_co *co;
+	size_t mapsz = co_mapsz();
+
+	/* Pending coroutines are not resumed, nor unwound */
+	_UEV_FOREACH(co, ctx->co) {
+		/* Called from coroutine, freed by resumer when done */
+		if (co->running)
+			continue;
+
+		_UEV_REMOVE(co, ctx->co);
+		munmap(co_base(co), mapsz);
+	}
+
+	_UEV_FOREACH(co, ctx->co_pool) {
+		_UEV_REMOVE(co, ctx->co_pool);
+		munmap(co_base(co), mapsz);
+	}
+	ctx->co_pooled = 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
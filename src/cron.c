@@ -42,6 +42,19 @@
  * @file cron.c
  */
 
+/* Create timerfd for new, or stopped, at/cron job watcher */
+static int cron_open(uev_t *w)
+{
+	int fd;
+
+	fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	w->fd = fd;
+
+	return 0;
+}
+
 /**
  * Create and start an at/cron job watcher
  * @param ctx      A valid libuEv context
@@ -65,24 +78,21 @@
  */
 int uev_cron_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, time_t when, time_t interval)
 {
-	int fd;
-
 	if (when < 0 || interval < 0) {
 		errno = ERANGE;
 		return -1;
 	}
 
-	fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC);
-	if (fd < 0)
+	if (_uev_watcher_init(ctx, w, UEV_CRON_TYPE, cb, arg, -1, UEV_READ))
 		return -1;
 
-	if (_uev_watcher_init(ctx, w, UEV_CRON_TYPE, cb, arg, fd, UEV_READ))
-		goto exit;
+	if (cron_open(w))
+		return -1;
 
 	if (uev_cron_set(w, when, interval)) {
 		_uev_watcher_stop(w);
-	exit:
-		close(fd);
+		close(w->fd);
+		w->fd = -1;
 		return -1;
 	}
 
@@ -116,7 +126,7 @@ int uev_cron_set(uev_t *w, time_t when, time_t interval)
 		if (!when && !interval)
 			return 0;
 
-		if (uev_cron_init(w->ctx, w, (uev_cb_t *)w->cb, w->arg, when, interval))
+		if (cron_open(w))
 			return -1;
 	}
 
@@ -23,7 +23,9 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>		/* calloc(), realloc(), free() */
 #include <sys/eventfd.h>
+#include <sys/mman.h>		/* mmap(), munmap() */
 #include <unistd.h>		/* close(), read() */
 
 #include "uev.h"
@@ -32,8 +34,254 @@
 /**
  * Linux [eventfd(2)](https://man7.org/linux/man-pages/man2/eventfd.2.html).
  * @file event.c
+ *
+ * By default each event watcher has its own eventfd.  In shared mode,
+ * see uev_event_shared_set(), all event watchers in a context share one
+ * eventfd, and posting sets the watcher's bit in a pending bitmap.  A
+ * summary bitmap, with one bit per bitmap word, lets the event loop find
+ * the pending watchers without scanning all words.  The bitmaps are in
+ * shared memory, so posts from forked children work as well.
  */
 
+#define EVS_WORDS   512			/* Bitmap words per page, 4 kiB */
+#define EVS_BITS    (EVS_WORDS * 64)	/* Watchers per page            */
+#define EVS_PAGES   32			/* Max 1M shared event watchers */
+
+/* Shared with forked children, like the bitmap pages */
+struct uev_evhdr {
+	uint64_t       signalled;	/* Eventfd written, not yet read  */
+	uint64_t       summary[EVS_PAGES * EVS_WORDS / 64];
+};
+
+struct uev_evshare {
+	uev_t          io;		/* Internal watcher for eventfd    */
+	int            num;		/* Number of shared event watchers */
+	struct uev_evhdr *hdr;
+	uint64_t      *page[EVS_PAGES];	/* Pending bitmap, on demand      */
+
+	struct uev   **slot;		/* Watcher for each bit, or NULL   */
+	int            slotsz;
+	int            hiwat;		/* Slots ever used                 */
+	int           *freed;		/* Stack of free slots, below hiwat */
+	int            nfreed;
+};
+
+static void *shm(size_t len)
+{
+	void *ptr;
+
+	ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (ptr == MAP_FAILED)
+		return NULL;
+
+	return ptr;
+}
+
+static uint64_t *word(struct uev_evshare *sh, int slot)
+{
+	return &sh->page[slot / EVS_BITS][(slot % EVS_BITS) / 64];
+}
+
+/* Put watcher on the ready list, dispatched without reading an eventfd */
+static void pend(uev_t *w)
+{
+	w->posted = 1;
+	if (!w->rq)
+		_UEV_ENQUEUE(w, &w->ctx->ready[w->prio - UEV_PRIO_MIN]);
+}
+
+/* Shared eventfd readable, find all pending watchers, a word at a time */
+static void drain(uev_t *iow, void *arg, int events)
+{
+	struct uev_evshare *sh = (struct uev_evshare *)arg;
+	struct uev_evhdr *hdr = sh->hdr;
+	uint64_t val;
+	int i, num;
+
+	if (events & UEV_ERROR) {
+		uev_io_start(iow);
+		return;
+	}
+
+	/* Posts from now on must write the eventfd again */
+	if (read(iow->fd, &val, sizeof(val)) != sizeof(val) && errno == EAGAIN)
+		uev_stat_spurious(iow);
+	__atomic_store_n(&hdr->signalled, 0, __ATOMIC_SEQ_CST);
+
+	num = (sh->hiwat + 64 * 64 - 1) / (64 * 64);
+	for (i = 0; i < num; i++) {
+		uint64_t sum;
+
+		sum = __atomic_exchange_n(&hdr->summary[i], 0, __ATOMIC_SEQ_CST);
+		while (sum) {
+			int pos = i * 64 + __builtin_ctzll(sum);
+			uint64_t bits;
+
+			sum &= sum - 1;
+			bits = __atomic_exchange_n(word(sh, pos * 64), 0, __ATOMIC_SEQ_CST);
+			while (bits) {
+				uev_t *w = sh->slot[pos * 64 + __builtin_ctzll(bits)];
+
+				bits &= bits - 1;
+				if (w)
+					pend(w);
+			}
+		}
+	}
+}
+
+/* Get the shared eventfd of a context, create on demand */
+static struct uev_evshare *evshare(uev_ctx_t *ctx)
+{
+	struct uev_evshare *sh = ctx->evshare;
+	int fd;
+
+	if (!sh) {
+		sh = calloc(1, sizeof(*sh));
+		if (!sh)
+			return NULL;
+
+		sh->hdr = shm(sizeof(*sh->hdr));
+		if (!sh->hdr)
+			goto fail;
+
+		fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd < 0)
+			goto fail;
+
+		if (_uev_watcher_init(ctx, &sh->io, UEV_IO_TYPE, drain, sh, fd, UEV_READ)) {
+			close(fd);
+			goto fail;
+		}
+		ctx->evshare = sh;
+	}
+
+	if (_uev_watcher_start(&sh->io))
+		return NULL;
+
+	return sh;
+fail:
+	if (sh->hdr)
+		munmap(sh->hdr, sizeof(*sh->hdr));
+	free(sh);
+	return NULL;
+}
+
+/* Bit in pending bitmap, reuse freed slots first */
+static int slot_alloc(struct uev_evshare *sh, uev_t *w)
+{
+	int slot;
+
+	if (sh->nfreed) {
+		slot = sh->freed[--sh->nfreed];
+		goto done;
+	}
+
+	slot = sh->hiwat;
+	if (slot >= EVS_PAGES * EVS_BITS) {
+		errno = ENOSPC;
+		return -1;
+	}
+
+	if (!sh->page[slot / EVS_BITS]) {
+		sh->page[slot / EVS_BITS] = shm(EVS_WORDS * sizeof(uint64_t));
+		if (!sh->page[slot / EVS_BITS])
+			return -1;
+	}
+
+	if (slot >= sh->slotsz) {
+		int sz = sh->slotsz ? sh->slotsz * 2 : 64;
+		struct uev **s;
+		int *f;
+
+		s = realloc(sh->slot, sz * sizeof(*s));
+		if (!s)
+			return -1;
+		sh->slot = s;
+
+		f = realloc(sh->freed, sz * sizeof(*f));
+		if (!f)
+			return -1;
+		sh->freed  = f;
+		sh->slotsz = sz;
+	}
+	sh->hiwat++;
+done:
+	sh->slot[slot] = w;
+
+	return slot;
+}
+
+static int shared_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg)
+{
+	struct uev_evshare *sh;
+	int slot;
+
+	sh = evshare(ctx);
+	if (!sh)
+		return -1;
+
+	if (_uev_watcher_init(ctx, w, UEV_EVENT_TYPE, cb, arg, sh->io.fd, UEV_READ))
+		goto fail;
+
+	slot = slot_alloc(sh, w);
+	if (slot < 0)
+		goto fail;
+
+	/* Not in the context's list of watchers, or in epoll */
+	w->u.e.slot = slot;
+	w->active   = 1;
+	sh->num++;
+
+	return 0;
+fail:
+	w->fd = -1;
+	if (!sh->num)
+		uev_io_stop(&sh->io);
+	return -1;
+}
+
+static int shared_post(uev_t *w)
+{
+	struct uev_evshare *sh = w->ctx->evshare;
+	int slot = w->u.e.slot;
+	int pos = slot / 64;
+	uint64_t val = 1;
+
+	__atomic_fetch_or(word(sh, slot), 1ULL << (slot % 64), __ATOMIC_SEQ_CST);
+	__atomic_fetch_or(&sh->hdr->summary[pos / 64], 1ULL << (pos % 64), __ATOMIC_SEQ_CST);
+
+	/* Only the first post since the loop last woke up writes */
+	if (__atomic_exchange_n(&sh->hdr->signalled, 1, __ATOMIC_SEQ_CST))
+		return 0;
+
+	if (write(w->fd, &val, sizeof(val)) != sizeof(val))
+		return -1;
+
+	return 0;
+}
+
+static int shared_stop(uev_t *w)
+{
+	struct uev_evshare *sh = w->ctx->evshare;
+	int slot = w->u.e.slot;
+
+	/* Drop any pending post, not in the context's list of watchers */
+	_uev_watcher_drop(w);
+	w->active = 0;
+	__atomic_fetch_and(word(sh, slot), ~(1ULL << (slot % 64)), __ATOMIC_SEQ_CST);
+
+	sh->slot[slot] = NULL;
+	sh->freed[sh->nfreed++] = slot;
+	w->u.e.slot = -1;
+	w->fd       = -1;
+
+	if (!--sh->num)
+		uev_io_stop(&sh->io);
+
+	return 0;
+}
+
 /**
  * Create a generic event watcher
  * @param ctx    A valid libuEv context
@@ -41,6 +289,9 @@
  * @param cb     Callback when an event is posted
  * @param arg    Optional callback argument
  *
+ * Each event watcher has its own eventfd, unless the context is in
+ * shared mode, see uev_event_shared_set().
+ *
  * @return POSIX OK(0) or non-zero with @p errno set on error.
  */
 int uev_event_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg)
@@ -53,18 +304,65 @@ int uev_event_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg)
 	}
 	w->fd = -1;
 
+	if (ctx->evshared)
+		return shared_init(ctx, w, cb, arg);
+
 	fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
 	if (fd < 0)
 		return -1;
 
-	return _uev_watcher_init(ctx, w, UEV_EVENT_TYPE, cb, arg, fd, UEV_READ)
-		|| _uev_watcher_start(w);
+	if (_uev_watcher_init(ctx, w, UEV_EVENT_TYPE, cb, arg, fd, UEV_READ))
+		return -1;
+	w->u.e.slot = -1;
+
+	return _uev_watcher_start(w);
+}
+
+/**
+ * Share one eventfd between event watchers
+ * @param ctx     A valid libuEv context
+ * @param enable  Non-zero to enable, zero to disable
+ *
+ * Every event watcher has its own eventfd by default.  Services with
+ * thousands of logical event sources, e.g., per-session notifications,
+ * may then run out of descriptors, and grow the epoll set.  In shared
+ * mode event watchers created with uev_event_init() instead share one
+ * eventfd per context, and a bit each in a pending bitmap.
+ *
+ * Posting sets the bit, and only the first post since the event loop
+ * last woke up writes to the eventfd.  The loop then dispatches all
+ * watchers with their bit set, finding them via a summary bitmap, one
+ * 64-bit word at a time.  Posts to the same watcher are coalesced, as
+ * with separate eventfds.  Up to 1M watchers can share an eventfd.
+ *
+ * Watchers already created are not changed, so the mode can be set
+ * any time.  Usually right after uev_init().
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_event_shared_set(uev_ctx_t *ctx, int enable)
+{
+	if (!ctx) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ctx->evshared = enable ? 1 : 0;
+
+	return 0;
 }
 
 /**
  * Post a generic event
  * @param w  Watcher to post to
  *
+ * Safe to call from any thread, or process, with access to the watcher.
+ * When called from the thread running the event loop, e.g., from
+ * another callback, the watcher is put directly on the ready list and
+ * called in the same loop iteration, without any system calls.  From
+ * other threads the eventfd is written to, waking up the loop.  Posts
+ * are coalesced, the callback is called at least once per wakeup.
+ *
  * @return POSIX OK(0) or non-zero with @p errno set on error.
  */
 int uev_event_post(uev_t *w)
@@ -76,6 +374,14 @@ int uev_event_post(uev_t *w)
 		return -1;
 	}
 
+	/* Only active watchers are queued, stopped ones see it when started */
+	if (_uev_watcher_active(w) && _uev_owner(w->ctx)) {
+		pend(w);
+		return 0;
+	}
+
+	if (w->u.e.slot >= 0)
+		return shared_post(w);
 
 	if (write(w->fd, &val, sizeof(val)) != sizeof(val))
 		return -1;
@@ -94,6 +400,9 @@ int uev_event_stop(uev_t *w)
 	if (!_uev_watcher_active(w))
 		return 0;
 
+	if (w->u.e.slot >= 0)
+		return shared_stop(w);
+
 	if (_uev_watcher_stop(w))
 		return -1;
 
@@ -103,6 +412,40 @@ int uev_event_stop(uev_t *w)
 	return 0;
 }
 
+/* Private to libuEv, do not use directly! */
+void _uev_event_exit(uev_ctx_t *ctx)
+{
+	struct uev_evshare *sh = ctx->evshare;
+	int i;
+
+	if (!sh)
+		return;
+
+	for (i = 0; i < sh->hiwat; i++) {
+		uev_t *w = sh->slot[i];
+
+		if (!w)
+			continue;
+		if (w->rq)
+			_UEV_DEQUEUE(w, w->rq);
+		w->active   = 0;
+		w->fd       = -1;
+		w->u.e.slot = -1;
+	}
+
+	uev_io_stop(&sh->io);
+	close(sh->io.fd);
+	for (i = 0; i < EVS_PAGES; i++) {
+		if (sh->page[i])
+			munmap(sh->page[i], EVS_WORDS * sizeof(uint64_t));
+	}
+	munmap(sh->hdr, sizeof(*sh->hdr));
+	free(sh->slot);
+	free(sh->freed);
+	free(sh);
+	ctx->evshare = NULL;
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
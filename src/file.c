@@ -0,0 +1,229 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2012       Flemming Madsen <flemming!madsen()madsensoft!dk>
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <fcntl.h>		/* open(), posix_fadvise() */
+#include <stdlib.h>		/* malloc(), free() */
+#include <sys/stat.h>
+#include <unistd.h>		/* close(), lseek(), read() */
+
+#include "uev.h"
+
+/* Read-ahead chunk handed to the callback */
+#define CHUNK_SIZE (256 * 1024)
+
+/**
+ * Streaming regular file reader
+ * @file file.c
+ *
+ * Regular files cannot be added to epoll, they are always readable.
+ * File reader watchers are instead kept in the ready queue, reading
+ * one large chunk per loop iteration, so they interleave fairly with
+ * other watchers.  The kernel is told to read ahead sequentially.
+ *
+ * The callback gets each chunk in uev::data and uev::len, valid until
+ * the callback returns.
+ */
+
+static int file_start(uev_t *w)
+{
+	struct stat st;
+
+	if (fstat(w->fd, &st))
+		return -1;
+
+	if (!S_ISREG(st.st_mode)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	w->u.f.buf = malloc(CHUNK_SIZE);
+	if (!w->u.f.buf)
+		return -1;
+	w->u.f.size = st.st_size;
+
+	/* Advisory only, errors ignored */
+	posix_fadvise(w->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	posix_fadvise(w->fd, lseek(w->fd, 0, SEEK_CUR), 4 * CHUNK_SIZE, POSIX_FADV_WILLNEED);
+
+	if (_uev_watcher_start(w)) {
+		free(w->u.f.buf);
+		w->u.f.buf = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Create and start a file reader watcher
+ * @param ctx    A valid libuEv context
+ * @param w      Pointer to an uev_t watcher
+ * @param cb     Callback for each chunk read
+ * @param arg    Optional callback argument
+ * @param fd     Regular file, e.g., a redirected `STDIN_FILENO`
+ *
+ * The file is read from its current offset.  The callback is called
+ * with ::UEV_READ for each chunk, and once with ::UEV_HUP, and zero
+ * uev::len, at end of file, or ::UEV_ERROR on read error.  The watcher
+ * is stopped before the last callback.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_file_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int fd)
+{
+	if (fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (_uev_watcher_init(ctx, w, UEV_FILE_TYPE, cb, arg, fd, UEV_READ))
+		return -1;
+	w->u.f.buf = NULL;
+	w->u.f.own = 0;
+
+	return file_start(w);
+}
+
+/**
+ * Open a file and start a file reader watcher
+ * @param ctx    A valid libuEv context
+ * @param w      Pointer to an uev_t watcher
+ * @param cb     Callback for each chunk read
+ * @param arg    Optional callback argument
+ * @param path   Path to regular file
+ *
+ * Same as uev_file_init(), but the file is opened, and closed when the
+ * watcher is stopped, by libuEv.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_file_open(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, const char *path)
+{
+	int fd;
+
+	if (!w || !path) {
+		errno = EINVAL;
+		return -1;
+	}
+	w->fd = -1;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (uev_file_init(ctx, w, cb, arg, fd)) {
+		close(fd);
+		w->fd = -1;
+		return -1;
+	}
+	w->u.f.own = 1;
+
+	return 0;
+}
+
+/**
+ * Stop a file reader watcher
+ * @param w  Watcher to stop
+ *
+ * The file descriptor is closed if the file was opened by uev_file_open().
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_file_stop(uev_t *w)
+{
+	if (!_uev_watcher_active(w))
+		return 0;
+
+	if (_uev_watcher_stop(w))
+		return -1;
+
+	free(w->u.f.buf);
+	w->u.f.buf = NULL;
+	w->data    = NULL;
+	w->len     = 0;
+
+	if (w->u.f.own) {
+		close(w->fd);
+		w->fd = -1;
+	}
+
+	return 0;
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_file_read(uev_t *w)
+{
+	ssize_t len;
+
+	len = read(w->fd, w->u.f.buf, CHUNK_SIZE);
+	if (len <= 0) {
+		uev_file_stop(w);
+		return len ? UEV_ERROR : UEV_HUP;
+	}
+
+	w->data = w->u.f.buf;
+	w->len  = len;
+
+	/* More to read, dispatch again next iteration */
+	w->revents |= UEV_READ;
+	if (!w->rq)
+		_UEV_ENQUEUE(w, &w->ctx->again);
+
+	return UEV_READ;
+}
+
+/*
+ * Private to libuEv, do not use directly!
+ *
+ * I/O watcher on a regular file, e.g. `application < file.txt`, check
+ * for end of file before the callback reads.  Only the offset is read
+ * until the size seen at start, or last check, is reached.
+ */
+int _uev_file_eof(uev_t *w)
+{
+	struct stat st;
+	off_t pos;
+
+	pos = lseek(w->fd, 0, SEEK_CUR);
+	if (pos < 0)
+		return 1;
+
+	if (pos < w->u.f.size)
+		return 0;
+
+	/* File may have grown */
+	if (fstat(w->fd, &st))
+		return 1;
+	w->u.f.size = st.st_size;
+
+	return pos >= w->u.f.size;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
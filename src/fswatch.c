@@ -0,0 +1,365 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2012       Flemming Madsen <flemming!madsen()madsensoft!dk>
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>		/* calloc(), free() */
+#include <string.h>		/* strcmp() */
+#include <sys/inotify.h>
+#include <unistd.h>		/* close(), read() */
+
+#include "uev.h"
+
+/**
+ * File system watcher, Linux [inotify(7)](https://man7.org/linux/man-pages/man7/inotify.7.html)
+ * @file fswatch.c
+ *
+ * All file system watchers in a context share one inotify descriptor.
+ * Events are read in large batches and dispatched to each watcher via
+ * a hash table on the inotify watch descriptor.
+ */
+
+#define FSW_BUCKETS  256		/* Watch descriptor hash table  */
+#define FSW_SLOTS    1024		/* Duplicate check, per batch   */
+#define FSW_BUFSIZ   (64 * 1024)	/* Batch of events, per read()  */
+
+struct uev_inotify {
+	uev_t          io;		/* Internal watcher for inotify fd */
+	int            num;		/* Number of file system watchers  */
+	uint32_t       gen;		/* Current batch, for slot[]       */
+	int            busy;		/* In batch(), defer free() on exit */
+	int            dead;		/* uev_exit() called from callback */
+	struct uev    *next;		/* Next watcher to dispatch        */
+
+	struct uev    *bucket[FSW_BUCKETS];
+	struct {
+		uint32_t gen;
+		uint32_t off;
+	} slot[FSW_SLOTS];
+
+	char           buf[FSW_BUFSIZ] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+};
+
+static struct uev **bucket(struct uev_inotify *in, int wd)
+{
+	return &in->bucket[(unsigned)wd % FSW_BUCKETS];
+}
+
+/*
+ * Check if event is identical to the last event on the same wd and name
+ * in this batch.  Only the last one, so events on a file are never
+ * reordered, e.g., CREATE, DELETE, CREATE is not merged.
+ */
+static int duplicate(struct uev_inotify *in, struct inotify_event *ev)
+{
+	uint32_t hash = ev->wd;
+	uint32_t i, off = (char *)ev - in->buf;
+	const char *p;
+
+	for (p = ev->name; ev->len && *p; p++)
+		hash = hash * 31 + *p;
+
+	for (i = 0; i < FSW_SLOTS; i++) {
+		uint32_t pos = (hash + i) % FSW_SLOTS;
+		struct inotify_event *prev;
+
+		if (in->slot[pos].gen != in->gen) {
+			in->slot[pos].gen = in->gen;
+			in->slot[pos].off = off;
+			return 0;
+		}
+
+		prev = (struct inotify_event *)&in->buf[in->slot[pos].off];
+		if (prev->wd != ev->wd ||
+		    strcmp(prev->len ? prev->name : "", ev->len ? ev->name : ""))
+			continue;
+
+		if (prev->mask == ev->mask)
+			return 1;
+
+		/* Last event on this file is now this one */
+		in->slot[pos].off = off;
+		return 0;
+	}
+
+	return 0;		/* Table full, dispatch anyway */
+}
+
+/*
+ * Call all watchers on wd, or all watchers on queue overflow.  The
+ * callback may stop, or free, its own watcher, or any other watcher,
+ * or call uev_exit().  So the callback must be the last action for a
+ * watcher and in->next is kept up to date by uev_fswatch_stop().
+ */
+static void dispatch(struct uev_inotify *in, struct inotify_event *ev)
+{
+	int i, first = 0, last = FSW_BUCKETS;
+	uev_t *w;
+
+	if (ev->wd != -1) {
+		first = bucket(in, ev->wd) - in->bucket;
+		last  = first + 1;
+	}
+
+	for (i = first; i < last; i++) {
+		for (w = in->bucket[i]; w; w = in->next) {
+			in->next = w->next;
+
+			if (ev->wd != -1 && w->fd != ev->wd)
+				continue;
+			if (!(ev->mask & (w->u.i.mask | IN_Q_OVERFLOW | IN_IGNORED | IN_UNMOUNT)))
+				continue;
+
+			/* Kernel has already removed the watch */
+			if (ev->mask & IN_IGNORED) {
+				_UEV_REMOVE(w, in->bucket[i]);
+				w->active = 0;
+				w->fd     = -1;
+				if (!--in->num)
+					uev_io_stop(&in->io);
+			}
+
+			/* Name is only valid in the callback, points into in->buf */
+			w->mask = ev->mask;
+			w->name = ev->len ? ev->name : NULL;
+			if (w->cb)
+				w->cb(w, w->arg, UEV_READ);
+			if (in->dead)
+				return;
+		}
+	}
+	in->next = NULL;
+}
+
+static void batch(uev_t *iow, void *arg, int events)
+{
+	struct uev_inotify *in = (struct uev_inotify *)arg;
+	ssize_t len;
+	char *ptr;
+
+	if (events & UEV_ERROR) {
+		uev_io_start(iow);
+		return;
+	}
+
+	len = read(iow->fd, in->buf, sizeof(in->buf));
+	if (len <= 0)
+		return;
+
+	in->gen++;
+	in->busy = 1;
+	for (ptr = in->buf; ptr < in->buf + len; ) {
+		struct inotify_event *ev = (struct inotify_event *)ptr;
+
+		ptr += sizeof(*ev) + ev->len;
+		if (duplicate(in, ev))
+			continue;
+
+		dispatch(in, ev);
+		if (in->dead || !iow->ctx->running)
+			break;
+	}
+	in->busy = 0;
+
+	/* Deferred by _uev_fswatch_exit(), must be last action */
+	if (in->dead)
+		free(in);
+}
+
+/* Get the shared inotify descriptor of a context, create on demand */
+static struct uev_inotify *inotify(uev_ctx_t *ctx)
+{
+	struct uev_inotify *in = ctx->inotify;
+	int fd;
+
+	if (!in) {
+		in = calloc(1, sizeof(*in));
+		if (!in)
+			return NULL;
+
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) {
+			free(in);
+			return NULL;
+		}
+
+		if (_uev_watcher_init(ctx, &in->io, UEV_IO_TYPE, batch, in, fd, UEV_READ)) {
+			close(fd);
+			free(in);
+			return NULL;
+		}
+		ctx->inotify = in;
+	}
+
+	if (_uev_watcher_start(&in->io))
+		return NULL;
+
+	return in;
+}
+
+/**
+ * Create and start a file system watcher
+ * @param ctx    A valid libuEv context
+ * @param w      Pointer to an uev_t watcher
+ * @param cb     Callback for file system events
+ * @param arg    Optional callback argument
+ * @param path   File or directory to watch
+ * @param mask   Events to watch for, e.g., `IN_CREATE | IN_MODIFY`
+ *
+ * The callback is called once for each event, with uev::mask set to
+ * the inotify(7) event mask, and uev::name to the file name for events
+ * on files in a watched directory, or NULL.  The name is only valid
+ * in the callback.  An event identical to the last event on the same
+ * file in a batch is coalesced, events on a file are never reordered.
+ *
+ * If the watched path is deleted, or unmounted, the callback is called
+ * with `IN_IGNORED` in uev::mask and the watcher is stopped.  All file
+ * system watchers get `IN_Q_OVERFLOW` if the kernel event queue has
+ * overflowed, i.e., events have been lost.
+ *
+ * File system watchers are dispatched by the shared inotify watcher, so
+ * they are not listed by uev_stat_next() and its profiling counters
+ * cover all of them.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_fswatch_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, const char *path, uint32_t mask)
+{
+	struct uev_inotify *in;
+	int wd;
+
+	if (!path || !mask) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (_uev_watcher_init(ctx, w, UEV_FSWATCH_TYPE, cb, arg, -1, UEV_READ))
+		return -1;
+	w->u.i.mask = mask;
+	w->mask     = 0;
+	w->name     = NULL;
+
+	in = inotify(ctx);
+	if (!in)
+		return -1;
+
+	/* Same path may be watched by others, add to the kernel's mask */
+	wd = inotify_add_watch(in->io.fd, path, mask | IN_MASK_ADD);
+	if (wd < 0) {
+		if (!in->num)
+			uev_io_stop(&in->io);
+		return -1;
+	}
+
+	w->fd     = wd;
+	w->active = 1;
+	_UEV_INSERT(w, *bucket(in, wd));
+	in->num++;
+
+	return 0;
+}
+
+/**
+ * Stop a file system watcher
+ * @param w  Watcher to stop
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_fswatch_stop(uev_t *w)
+{
+	struct uev_inotify *in;
+	struct uev **head;
+	uev_t *other;
+	int wd;
+
+	if (!_uev_watcher_active(w))
+		return 0;
+
+	in   = w->ctx->inotify;
+	wd   = w->fd;
+	head = bucket(in, wd);
+
+	/* Stopped from a callback, skip in dispatch() */
+	if (in->next == w)
+		in->next = w->next;
+
+	_UEV_REMOVE(w, *head);
+	w->active = 0;
+	w->fd     = -1;
+	w->name   = NULL;
+	in->num--;
+
+	/* Keep the kernel watch if others still use it */
+	_UEV_FOREACH(other, *head) {
+		if (other->fd == wd)
+			return 0;
+	}
+
+	if (!in->num)
+		uev_io_stop(&in->io);
+
+	if (inotify_rm_watch(in->io.fd, wd) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* Private to libuEv, do not use directly! */
+void _uev_fswatch_exit(uev_ctx_t *ctx)
+{
+	struct uev_inotify *in = ctx->inotify;
+	uev_t *w;
+	int i;
+
+	if (!in)
+		return;
+
+	for (i = 0; i < FSW_BUCKETS; i++) {
+		_UEV_FOREACH(w, in->bucket[i]) {
+			w->active = 0;
+			w->fd     = -1;
+			w->name   = NULL;
+			w->next   = NULL;
+			w->prev   = NULL;
+		}
+	}
+
+	uev_io_stop(&in->io);
+	close(in->io.fd);
+	ctx->inotify = NULL;
+
+	/* Called from a callback, batch() frees when it returns */
+	if (in->busy) {
+		in->next = NULL;
+		in->dead = 1;
+		return;
+	}
+	free(in);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
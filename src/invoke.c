@@ -0,0 +1,238 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdlib.h>		/* malloc(), free() */
+#include <sys/eventfd.h>
+#include <unistd.h>		/* close(), read(), write() */
+
+#include "uev.h"
+
+/**
+ * Remote control of a context from other threads
+ * @file invoke.c
+ *
+ * Commands are pushed on a lock-free stack in the context, a Treiber
+ * stack, and the event loop is woken up by a shared eventfd.  The loop
+ * takes the whole stack at once, so there is no ABA problem, reverses
+ * it, and runs the commands in the order they were invoked.  Only the
+ * command pushed on an empty stack writes to the eventfd, the rest are
+ * batched with it.
+ */
+
+struct uev_cmd {
+	struct uev_cmd *next;
+	uev_invoke_fn_t *fn;
+	void           *arg;
+};
+
+struct uev_remote {
+	uev_t           io;		/* Internal watcher for eventfd */
+};
+
+/* Run all queued commands, oldest first */
+static void commands(uev_ctx_t *ctx)
+{
+	struct uev_cmd *cmd, *next, *list = NULL;
+
+	cmd = __atomic_exchange_n(&ctx->cmds, NULL, __ATOMIC_SEQ_CST);
+	while (cmd) {
+		next      = cmd->next;
+		cmd->next = list;
+		list      = cmd;
+		cmd       = next;
+	}
+
+	for (cmd = list; cmd; cmd = next) {
+		next = cmd->next;
+		if (ctx->running)
+			cmd->fn(ctx, cmd->arg);
+		free(cmd);
+	}
+}
+
+/* Not a watcher of the user's, keep the loop from running forever */
+static void unlist(uev_t *w)
+{
+	_UEV_REMOVE(w, w->ctx->watchers);
+}
+
+static void wakeup(uev_t *w, void *arg, int events)
+{
+	uev_ctx_t *ctx = (uev_ctx_t *)arg;
+	uint64_t val;
+
+	if (events & UEV_ERROR) {
+		if (!uev_io_start(w))
+			unlist(w);
+		return;
+	}
+
+	if (read(w->fd, &val, sizeof(val)) != sizeof(val) && errno == EAGAIN)
+		uev_stat_spurious(w);
+
+	/* Watcher is freed if a command calls uev_exit() */
+	commands(ctx);
+}
+
+/*
+ * Private to libuEv, do not use directly!  Called by the event loop,
+ * in its own thread, so only the loop creates the eventfd.  Commands
+ * invoked before it existed are run here.
+ */
+int _uev_invoke_init(uev_ctx_t *ctx)
+{
+	struct uev_remote *r = ctx->remote;
+	int fd;
+
+	if (!r) {
+		r = calloc(1, sizeof(*r));
+		if (!r)
+			return -1;
+
+		fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (fd < 0) {
+			free(r);
+			return -1;
+		}
+
+		if (_uev_watcher_init(ctx, &r->io, UEV_IO_TYPE, wakeup, ctx, fd, UEV_READ) ||
+		    _uev_watcher_start(&r->io)) {
+			close(fd);
+			free(r);
+			return -1;
+		}
+
+		unlist(&r->io);
+		__atomic_store_n(&ctx->remote, r, __ATOMIC_SEQ_CST);
+	}
+
+	commands(ctx);
+
+	return 0;
+}
+
+/* Private to libuEv, do not use directly! */
+void _uev_invoke_exit(uev_ctx_t *ctx)
+{
+	struct uev_remote *r = ctx->remote;
+	struct uev_cmd *cmd, *next;
+
+	/* Never run, the loop is gone */
+	cmd = __atomic_exchange_n(&ctx->cmds, NULL, __ATOMIC_SEQ_CST);
+	for (; cmd; cmd = next) {
+		next = cmd->next;
+		free(cmd);
+	}
+
+	if (!r)
+		return;
+
+	uev_io_stop(&r->io);
+	close(r->io.fd);
+	free(r);
+	ctx->remote = NULL;
+}
+
+/**
+ * Run a function in the event loop's thread
+ * @param ctx  A valid libuEv context
+ * @param fn   Function to call, with @p ctx and @p arg
+ * @param arg  Optional argument to @p fn
+ *
+ * Only the thread running the event loop may call the rest of the API
+ * on a context and its watchers.  This function is the exception, it
+ * may be called from any thread, to have @p fn called by the event loop
+ * which then can, e.g., start or stop watchers, reschedule timers with
+ * uev_timer_set(), or stop the loop with uev_exit():
+ *
+ *     static void later(uev_ctx_t *ctx, void *arg)
+ *     {
+ *             uev_timer_set(arg, 100, 0);
+ *     }
+ *
+ *     uev_invoke(ctx, later, &timer);
+ *
+ * Commands are queued on a lock-free stack and run in the order they
+ * were invoked, from an internal I/O watcher at the default priority,
+ * dispatched like any other watcher, or when the loop is started.
+ * A burst of commands only wakes up the event loop once.  If called
+ * from the thread running the loop, e.g., from a callback, @p fn is
+ * called right away.  Commands still queued when the context is closed
+ * with uev_exit() are dropped.
+ *
+ * Note: not for use in forked children, the queue is process local,
+ *       use an event watcher, uev_event_post(), instead.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_invoke(uev_ctx_t *ctx, uev_invoke_fn_t *fn, void *arg)
+{
+	struct uev_remote *r;
+	struct uev_cmd *cmd, *head;
+	uint64_t val = 1;
+
+	if (!ctx || !fn) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (_uev_owner(ctx)) {
+		fn(ctx, arg);
+		return 0;
+	}
+
+	cmd = malloc(sizeof(*cmd));
+	if (!cmd)
+		return -1;
+	cmd->fn  = fn;
+	cmd->arg = arg;
+
+	/* Once pushed, cmd may already be run and freed by the loop */
+	head = __atomic_load_n(&ctx->cmds, __ATOMIC_RELAXED);
+	do {
+		cmd->next = head;
+	} while (!__atomic_compare_exchange_n(&ctx->cmds, &head, cmd, 1,
+					      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+	/* Loop already woken up, or about to be, by an earlier command */
+	if (head)
+		return 0;
+
+	/* Not yet run, commands are run when the loop starts */
+	r = __atomic_load_n(&ctx->remote, __ATOMIC_SEQ_CST);
+	if (!r)
+		return 0;
+
+	if (write(r->io.fd, &val, sizeof(val)) != sizeof(val))
+		return -1;
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -23,6 +23,7 @@
  */
 
 #include <errno.h>
+#include <stdint.h>		/* UINT64_MAX */
 #include "uev.h"
 
 /**
@@ -30,6 +31,116 @@
  * @file io.c
  */
 
+/* Add tokens for the time since the last refill, up to the bucket size */
+static void rate_refill(uev_t *w)
+{
+	double add, room;
+	int64_t num;
+
+	if (w->ctx->now <= w->tb.stamp)
+		return;
+
+	add  = (double)(w->ctx->now - w->tb.stamp) * w->tb.rate / 1e9;
+	room = (double)w->tb.burst - w->tb.tokens;
+	if (add >= room) {
+		w->tb.tokens = w->tb.burst;
+		w->tb.stamp  = w->ctx->now;
+		return;
+	}
+
+	/* Whole tokens only, the remainder is kept in the time stamp */
+	num = (int64_t)add;
+	w->tb.tokens += num;
+	w->tb.stamp  += (uint64_t)(num * 1e9 / w->tb.rate);
+}
+
+/* One deadline in the context's heap, the earliest of refill and idle */
+static int io_schedule(uev_t *w)
+{
+	uint64_t due = 0;
+
+	if (!_uev_watcher_active(w)) {
+		_uev_deadline_del(w);
+		return 0;
+	}
+
+	if (w->paused)
+		due = w->tb.due;
+	if (w->idle && (!due || w->last + w->idle < due))
+		due = w->last + w->idle;
+
+	if (!due) {
+		_uev_deadline_del(w);
+		return 0;
+	}
+
+	return _uev_deadline_set(w, due);
+}
+
+/*
+ * Hold back ::UEV_WRITE while in debt.  The refill is a deadline in the
+ * context's heap, when the bucket is half full, not at every token, to
+ * not wake up for every byte.
+ */
+static int rate_check(uev_t *w)
+{
+	uint64_t want;
+
+	if (!_uev_watcher_active(w))
+		return 0;
+
+	if (w->tb.tokens > 0) {
+		if (_uev_watcher_pause(w, 0))
+			return -1;
+		return io_schedule(w);
+	}
+
+	want = w->tb.burst / 2;
+	if (!want)
+		want = 1;
+	w->tb.due = w->tb.stamp + (uint64_t)((want - w->tb.tokens) * 1e9 / w->tb.rate) + 1;
+	if (_uev_watcher_pause(w, UEV_WRITE))
+		return -1;
+
+	return io_schedule(w);
+}
+
+/* Watcher (re)started, keep rate limit and restart idle timeout */
+static int io_resume(uev_t *w)
+{
+	w->last = w->ctx->now;
+	if (w->tb.rate && w->tb.tokens <= 0)
+		return rate_check(w);
+
+	return io_schedule(w);
+}
+
+/*
+ * Private to libuEv, do not use directly!  Deadline expired, refill the
+ * token bucket, and check for idle timeout.  The idle deadline is not
+ * moved on every dispatch, only the time stamp, so it may have expired
+ * early, in which case it is rescheduled.
+ */
+int _uev_io_expire(uev_t *w)
+{
+	uint64_t now = w->ctx->now;
+	int events = 0;
+
+	if (w->paused && now >= w->tb.due) {
+		rate_refill(w);
+		rate_check(w);
+	}
+
+	if (w->idle && now >= w->last + w->idle) {
+		w->last = now;
+		events  = UEV_TIMEOUT;
+	}
+
+	io_schedule(w);
+
+	return events;
+}
+
 /**
  * Create an I/O watcher
  * @param ctx     A valid libuEv context
@@ -67,10 +178,24 @@ int uev_io_set(uev_t *w, int fd, int events)
 	if ((events & UEV_ONESHOT) && _uev_watcher_active(w))
 		return _uev_watcher_rearm(w);
 
+	if (fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
 	/* Ignore any errors, only to clean up anything lingering ... */
 	uev_io_stop(w);
 
-	return uev_io_init(w->ctx, w, (uev_cb_t *)w->cb, w->arg, fd, events);
+	w->fd     = fd;
+	w->events = events;
+
+	if (_uev_watcher_start(w))
+		return -1;
+
+	if (w->tb.rate || w->idle)
+		return io_resume(w);
+
+	return 0;
 }
 
 /**
@@ -95,6 +220,166 @@ int uev_io_stop(uev_t *w)
 	return _uev_watcher_stop(w);
 }
 
+/**
+ * Requeue an I/O watcher
+ * @param w  Watcher to dispatch again
+ *
+ * Used by callbacks that stop reading, or writing, before the
+ * descriptor returns EAGAIN, e.g., to not monopolize the event loop
+ * with a fast peer.  With ::UEV_EDGE the kernel will not notify again
+ * until more data arrives, so libuEv keeps the watcher in a userspace
+ * ready list instead.  The callback is called again in the next loop
+ * iteration, after all other ready watchers, round-robin style, without
+ * any extra epoll_wait() calls.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_io_requeue(uev_t *w)
+{
+	if (!w || !w->ctx || w->type != UEV_IO_TYPE) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!_uev_watcher_active(w)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	w->revents |= w->events & ~w->paused & (UEV_READ | UEV_WRITE | UEV_PRI);
+	if (!w->rq)
+		_UEV_ENQUEUE(w, &w->ctx->again);
+
+	return 0;
+}
+
+/**
+ * Rate limit an I/O watcher
+ * @param w      Pointer to an initialized I/O watcher
+ * @param rate   Tokens per second, e.g., bytes, or zero to disable
+ * @param burst  Size of token bucket, tokens available at once
+ *
+ * Attaches a token bucket to the watcher, for pacing writes.  The bucket
+ * starts out full.  The callback calls uev_io_rate_consume() with what
+ * it has written.  When the bucket runs dry ::UEV_WRITE is held back,
+ * the callback is not called for it, until the bucket has refilled to
+ * half its size.  Events other than ::UEV_WRITE are not affected.
+ *
+ * Refills are scheduled in a heap of deadlines in the context, which
+ * sets the timeout of epoll_wait().  So pacing thousands of connections
+ * costs no extra descriptors, and no system calls for timers, only one
+ * epoll_ctl() when writing is held back and one when it is resumed.
+ *
+ * The bucket is kept when the watcher is stopped and started again,
+ * uev_io_init() removes it.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_io_rate_set(uev_t *w, uint64_t rate, uint64_t burst)
+{
+	if (!w || !w->ctx || w->type != UEV_IO_TYPE || (rate && !burst) ||
+	    burst > INT64_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!rate) {
+		w->tb.rate = 0;
+		if (_uev_watcher_pause(w, 0))
+			return -1;
+		return io_schedule(w);
+	}
+
+	w->tb.rate   = rate;
+	w->tb.burst  = burst;
+	w->tb.tokens = burst;
+	w->tb.stamp  = w->ctx->now;
+
+	return rate_check(w);
+}
+
+/**
+ * Take tokens from a rate limited I/O watcher
+ * @param w    Pointer to a rate limited I/O watcher
+ * @param num  Number of tokens, e.g., bytes written
+ *
+ * May take more tokens than available, e.g., when writing a message in
+ * one go.  The debt is paid off, with ::UEV_WRITE held back, before the
+ * callback is called again for writing.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_io_rate_consume(uev_t *w, size_t num)
+{
+	if (!w || !w->ctx || !w->tb.rate || num > INT64_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	rate_refill(w);
+	w->tb.tokens -= (int64_t)num;
+	if (w->tb.tokens > 0)
+		return 0;
+
+	return rate_check(w);
+}
+
+/**
+ * Tokens available in a rate limited I/O watcher
+ * @param w  Pointer to an I/O watcher
+ *
+ * Useful to limit the size of the next write.
+ *
+ * @return Number of tokens available, zero when in debt, or @c UINT64_MAX
+ * if the watcher is not rate limited.
+ */
+uint64_t uev_io_rate_avail(uev_t *w)
+{
+	if (!w || !w->ctx || !w->tb.rate)
+		return UINT64_MAX;
+
+	rate_refill(w);
+	if (w->tb.tokens <= 0)
+		return 0;
+
+	return w->tb.tokens;
+}
+
+/**
+ * Set idle timeout of an I/O watcher
+ * @param w     Pointer to an initialized I/O watcher
+ * @param msec  Timeout in milliseconds, or zero to disable
+ *
+ * The callback is called with ::UEV_TIMEOUT set in @p events when no
+ * other event has been dispatched to the watcher for @p msec, and then
+ * again every @p msec until there is.  Usually the connection is closed
+ * and the watcher stopped, or the timeout disabled.
+ *
+ * Any event dispatched to the watcher restarts the timeout.  So for an
+ * inactivity timeout on a connection, set it on the watcher for reading.
+ *
+ * Unlike a separate timer watcher, which costs a timerfd and calls to
+ * timerfd_settime() for every read, the timeout is a deadline in the
+ * context's heap, see uev_io_rate_set(), and restarting it only takes
+ * a time stamp.  The timeout is kept when the watcher is stopped and
+ * started again, uev_io_init() removes it.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_io_timeout_set(uev_t *w, int msec)
+{
+	if (!w || !w->ctx || w->type != UEV_IO_TYPE || msec < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	w->idle = msec * 1000000ULL;
+	if (!_uev_watcher_active(w))
+		return 0;
+
+	return io_resume(w);
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -0,0 +1,307 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2012       Flemming Madsen <flemming!madsen()madsensoft!dk>
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Cross-thread wakeup latency benchmark, a ring of threads with one
+ * event loop each pass a token to the next using event watchers, i.e.,
+ * uev_event_post() and eventfd.  The latency of each hop, from post to
+ * callback in the next thread, is recorded in a histogram.  Reports the
+ * percentiles with and without CPU pinning, and busy polling.
+ *
+ * Busy polling, and pinning to different CPUs, only makes sense with at
+ * least as many CPU cores as threads.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uev.h"
+
+/*
+ * Log-linear histogram, exact below 64 ns, then 32 buckets for each
+ * power of two, i.e., within ~3%.  Covers the full 64-bit range.
+ */
+#define SUB_BITS  5
+#define SUB       (1 << SUB_BITS)
+#define BUCKETS   (2 * SUB + (64 - SUB_BITS - 1) * SUB)
+
+struct peer {
+	uev_ctx_t    ctx;
+	uev_t        ev;
+	int          cpu;	/* Pinned to, or -1 */
+	pthread_t    tid;
+	struct peer *next;
+};
+
+static int laps = 100000;
+static int threads = 2;
+static int done, hops, left;
+static uint64_t stamp, max;
+static uint64_t hist[BUCKETS];
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bucket(uint64_t ns)
+{
+	int e;
+
+	if (ns < 2 * SUB)
+		return ns;
+
+	e = 63 - __builtin_clzll(ns);
+	return 2 * SUB + (e - SUB_BITS - 1) * SUB + ((ns >> (e - SUB_BITS)) & (SUB - 1));
+}
+
+/* Lowest value in bucket */
+static uint64_t value(int i)
+{
+	int e;
+
+	if (i < 2 * SUB)
+		return i;
+
+	i -= 2 * SUB;
+	e  = i / SUB + SUB_BITS + 1;
+
+	return (uint64_t)(SUB + i % SUB) << (e - SUB_BITS);
+}
+
+static uint64_t pct(double p)
+{
+	uint64_t sum = 0, want = (uint64_t)(p * hops / 100.0);
+	int i;
+
+	for (i = 0; i < BUCKETS; i++) {
+		sum += hist[i];
+		if (sum > want)
+			return value(i);
+	}
+
+	return max;
+}
+
+/*
+ * Only the peer holding the token runs, so the shared counters need no
+ * locking, posting to the eventfd orders them between threads.
+ */
+static void hop_cb(uev_t *w, void *arg, int events)
+{
+	struct peer *p = arg;
+	uint64_t lat;
+
+	if (done) {
+		/* Pass on the news, but not to any peer that already left */
+		if (++left < threads)
+			uev_event_post(&p->next->ev);
+		uev_exit(w->ctx);
+		return;
+	}
+
+	lat = now() - stamp;
+	hist[bucket(lat)]++;
+	if (lat > max)
+		max = lat;
+
+	if (++hops == laps) {
+		done = 1;
+		left = 1;
+		uev_event_post(&p->next->ev);
+		uev_exit(w->ctx);
+		return;
+	}
+
+	stamp = now();
+	uev_event_post(&p->next->ev);
+}
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (cpu < 0)
+		return;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	errno = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (errno)
+		perror("pthread_setaffinity_np");
+}
+
+static void *peer(void *arg)
+{
+	struct peer *p = arg;
+
+	pin(p->cpu);
+	uev_run(&p->ctx, 0);
+
+	return NULL;
+}
+
+/* CPU for each peer, round-robin over the CPUs we may run on */
+static void cpus(struct peer *peers, int pinned)
+{
+	cpu_set_t set;
+	int i, cpu = 0;
+
+	if (sched_getaffinity(0, sizeof(set), &set))
+		pinned = 0;
+
+	for (i = 0; i < threads; i++) {
+		peers[i].cpu = -1;
+		if (!pinned)
+			continue;
+
+		while (!CPU_ISSET(cpu, &set))
+			cpu = (cpu + 1) % CPU_SETSIZE;
+		peers[i].cpu = cpu;
+		cpu = (cpu + 1) % CPU_SETSIZE;
+	}
+}
+
+static int run(int pinned, int busy)
+{
+	struct peer *peers;
+	cpu_set_t orig;
+	int i;
+
+	peers = calloc(threads, sizeof(*peers));
+	if (!peers) {
+		perror("calloc");
+		return 1;
+	}
+
+	done = hops = left = 0;
+	max = 0;
+	memset(hist, 0, sizeof(hist));
+
+	cpus(peers, pinned);
+	for (i = 0; i < threads; i++) {
+		struct peer *p = &peers[i];
+
+		uev_init(&p->ctx);
+		uev_event_init(&p->ctx, &p->ev, hop_cb, p);
+		uev_busypoll_set(&p->ctx, busy);
+		p->next = &peers[(i + 1) % threads];
+	}
+
+	/* Peer 0 is this thread, which starts the token */
+	for (i = 1; i < threads; i++) {
+		if (pthread_create(&peers[i].tid, NULL, peer, &peers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sched_getaffinity(0, sizeof(orig), &orig);
+	pin(peers[0].cpu);
+
+	stamp = now();
+	uev_event_post(&peers[1 % threads].ev);
+	uev_run(&peers[0].ctx, 0);
+
+	for (i = 1; i < threads; i++)
+		pthread_join(peers[i].tid, NULL);
+	sched_setaffinity(0, sizeof(orig), &orig);
+	free(peers);
+
+	printf("%6s %6d %8llu %8llu %8llu %8llu %8llu\n", pinned ? "yes" : "no",
+	       busy, (unsigned long long)pct(50), (unsigned long long)pct(90),
+	       (unsigned long long)pct(99), (unsigned long long)pct(99.9),
+	       (unsigned long long)max);
+
+	return 0;
+}
+
+static int usage(int rc)
+{
+	fprintf(stderr,
+		"Usage: pingpong [-h] [-n HOPS] [-s USEC] [-t THREADS]\n"
+		"\n"
+		"  -h          This help text\n"
+		"  -n HOPS     Number of hops, default: 100000\n"
+		"  -s USEC     Max busy poll window, default: 50\n"
+		"  -t THREADS  Number of threads in ring, default: 2\n");
+
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	int c, busy = 50, pinned;
+
+	while ((c = getopt(argc, argv, "hn:s:t:")) != -1) {
+		switch (c) {
+		case 'h':
+			return usage(0);
+
+		case 'n':
+			laps = atoi(optarg);
+			break;
+
+		case 's':
+			busy = atoi(optarg);
+			break;
+
+		case 't':
+			threads = atoi(optarg);
+			break;
+
+		default:
+			return usage(1);
+		}
+	}
+
+	if (laps < 1 || busy < 0 || threads < 2)
+		return usage(1);
+
+	printf("# Wakeup latency per hop (ns), %d threads, %d hops\n", threads, laps);
+	printf("# %4s %6s %8s %8s %8s %8s %8s\n", "pin", "spin", "p50", "p90", "p99", "p99.9", "max");
+	for (pinned = 0; pinned < 2; pinned++) {
+		if (run(pinned, 0) || (busy && run(pinned, busy)))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -25,9 +25,24 @@
 #ifndef LIBUEV_PRIVATE_H_
 #define LIBUEV_PRIVATE_H_
 
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <sys/epoll.h>
 #include <sys/signalfd.h>
+#include <sys/types.h>
+
+#include "uev_conf.h"
+
+/*
+ * Hot path helpers in the event loop, forced inline with --enable-inline,
+ * otherwise left to the compiler.
+ */
+#if UEV_INLINE
+#define _UEV_HOT static inline __attribute__((always_inline))
+#else
+#define _UEV_HOT static
+#endif
 
 /*
  * List functions.
@@ -61,6 +76,34 @@
 		list = next;			\
 } while (0)
 
+/*
+ * Ready queue functions, FIFO order.
+ */
+#define _UEV_ENQUEUE(node, q) do {		\
+	node->rnext = NULL;			\
+	node->rprev = (q)->tail;		\
+	if ((q)->tail)				\
+		(q)->tail->rnext = node;	\
+	else					\
+		(q)->head = node;		\
+	(q)->tail = node;			\
+	node->rq = q;				\
+} while (0)
+
+#define _UEV_DEQUEUE(node, q) do {		\
+	if (node->rprev)			\
+		node->rprev->rnext = node->rnext; \
+	else					\
+		(q)->head = node->rnext;	\
+	if (node->rnext)			\
+		node->rnext->rprev = node->rprev; \
+	else					\
+		(q)->tail = node->rprev;	\
+	node->rnext = NULL;			\
+	node->rprev = NULL;			\
+	node->rq    = NULL;			\
+} while (0)
+
 /* I/O, timer, or signal watcher */
 typedef enum {
 	UEV_IO_TYPE = 1,
@@ -68,19 +111,100 @@ typedef enum {
 	UEV_TIMER_TYPE,
 	UEV_CRON_TYPE,
 	UEV_EVENT_TYPE,
+	UEV_CHILD_TYPE,
+	UEV_FSWATCH_TYPE,
+	UEV_FILE_TYPE,
 } uev_type_t;
 
+/* Active watcher not in epoll, e.g. regular file, driven by ready queue */
+#define _UEV_QUEUED     2
+
 /* Event mask, used internally only. */
 #define UEV_EVENT_MASK  (UEV_ERROR | UEV_READ | UEV_WRITE | UEV_PRI |	\
-			 UEV_RDHUP | UEV_HUP  | UEV_EDGE  | UEV_ONESHOT)
+			 UEV_RDHUP | UEV_HUP  | UEV_EDGE  | UEV_ONESHOT |	\
+			 UEV_TIMEOUT)
+
+/* Number of watcher priority levels, UEV_PRIO_MIN .. UEV_PRIO_MAX */
+#define _UEV_PRIO_LEVELS 5
+
+/* Queue of watchers with events ready to be dispatched */
+struct uev_queue {
+	struct uev     *head, *tail;
+};
+
+/* Watchers sharing a descriptor, registered once with the kernel */
+struct uev_fd {
+	struct uev     *head;	    /* Watchers on fd, linked by fnext */
+	uint32_t        events;	    /* Union of interests, in kernel */
+	int             epfd;	    /* Epoll set fd is in, or -1 */
+};
+
+/* Shared inotify descriptor for file system watchers, see fswatch.c */
+struct uev_inotify;
+
+/* Shared eventfd for event watchers, see event.c */
+struct uev_evshare;
+
+/* Remote commands from other threads, see invoke.c */
+struct uev_cmd;
+struct uev_remote;
+
+/* Coroutine, see co.c */
+struct uev_co;
 
 /* Main libuEv context type, internal use only! */
 struct uev_ctx {
 	int             running;
 	int             fd;	    /* For epoll() */
+	int             hifd;	    /* For epoll(), UEV_PRIO_MAX watchers */
 	int             maxevents;  /* For epoll() */
 	struct uev     *watchers;
-	uint32_t        workaround; /* For workarounds, e.g. redirected stdin */
+	struct uev_fd  *fds;	    /* Registry, indexed by fd */
+	int             fdsz;	    /* Size of registry */
+	struct uev_queue ready[_UEV_PRIO_LEVELS];
+	struct uev_queue again;	    /* Requeued, dispatched next iteration */
+	int             budget;	    /* Max callbacks per iteration, or 0 */
+	int             budget_us;  /* Max usec in callbacks per iteration, or 0 */
+	uint64_t        now;	    /* CLOCK_MONOTONIC at last wakeup, nsec */
+	uint64_t        now_real;   /* CLOCK_REALTIME, sampled on demand, or 0 */
+	struct uev_inotify *inotify;
+	struct uev_evshare *evshare;
+	int             evshared;   /* New event watchers use evshare */
+	struct uev_cmd *cmds;	    /* Lock-free stack, newest first */
+	struct uev_remote *remote;  /* Wakeup eventfd, from first uev_run() */
+
+	/* Lag monitor, see uev_lag_set() */
+	struct {
+		int      on;
+		int      overload;	/* Threshold crossed, hook called */
+		uint64_t max_lag;	/* Threshold, nsec, or 0 */
+		double   max_util;	/* Threshold, 0.0 - 1.0, or 0 */
+		void   (*cb)(struct uev_ctx *, void *, int);
+		void    *arg;
+
+		uint64_t lag;		/* Timer lag, EWMA, nsec */
+		uint64_t peak;		/* Max timer lag since uev_lag_get() */
+		double   util;		/* Busy time / wall time, EWMA */
+		uint64_t wake;		/* Last return from epoll_wait() */
+		uint64_t sleep;		/* Last call to epoll_wait() */
+	} lag;
+	struct uev    **heap;	    /* Deadlines, min-heap from index 1 */
+	int             heapsz;	    /* Size of heap, in entries */
+	int             heapcnt;    /* Watchers in heap */
+	struct uev_co  *co;	    /* Coroutines not yet done */
+	struct uev_co  *co_pool;    /* Unused coroutine stacks */
+	int             co_pooled;
+	int             busy_us;    /* Max busy poll window, usec, or 0 */
+	uint64_t        busy_avg;   /* Average time between wakeups, nsec */
+	uint64_t        busy_last;  /* Last wakeup with events */
+	int             profile;    /* Per-watcher counters enabled */
+	struct uev     *prof_w;	    /* In callback, CPU time not yet charged */
+	uint64_t        prof_cpu;   /* Thread CPU time at callback start */
+	struct uev     *stat_w;	    /* Last returned by uev_stat_next() */
+	struct uev     *stat_next;  /* Its next, if it is stopped */
+	int             owned;	    /* Loop running, in thread owner */
+	pthread_t       owner;	    /* For uev_event_post() and uev_invoke() */
+	unsigned int    forks;	    /* Forks seen when loop started */
 };
 
 /* Forward declare due to dependencys, don't try this at home kids. */
@@ -93,6 +217,41 @@ struct uev;
 	int             active;                                 \
 	int             events;                                 \
 								\
+	/* Dispatch order and pending events from epoll() */	\
+	int             prio;					\
+	int             revents;				\
+	struct uev     *rnext, *rprev;				\
+	struct uev_queue *rq;					\
+	struct uev     *fnext;	/* Next watcher on same fd */	\
+	int             paused;	/* Events held back */		\
+	int             fired;	/* UEV_ONESHOT disarmed */ \
+	int             posted;	/* Same-thread uev_event_post() */ \
+								\
+	/* Deadline in context's heap, no timerfd needed */	\
+	uint64_t        due;					\
+	int             hidx;	/* Index in heap, or 0 */	\
+								\
+	/* Token bucket, see uev_io_rate_set() */		\
+	struct {						\
+		uint64_t rate;	/* Tokens per second, or 0 */	\
+		uint64_t burst;	/* Bucket size */		\
+		int64_t  tokens; /* Negative when in debt */	\
+		uint64_t stamp;	/* Last refill */		\
+		uint64_t due;	/* Refill, when paused */	\
+	} tb;							\
+								\
+	/* Idle timeout, see uev_io_timeout_set() */		\
+	uint64_t        idle;	/* Timeout, nsec, or 0 */	\
+	uint64_t        last;	/* Last dispatch */		\
+								\
+	/* Profiling counters, see uev_profile_set() */		\
+	struct {						\
+		uint64_t count;	/* Callbacks */			\
+		uint64_t cpu;	/* Thread CPU time, nsec */	\
+		uint64_t last;	/* Loop time of last callback */ \
+		uint64_t spurious;				\
+	} prof;							\
+								\
 	/* Watcher callback with optional argument */           \
 	void          (*cb)(struct uev *, void *, int);         \
 	void           *arg;                                    \
@@ -105,24 +264,88 @@ struct uev;
 			time_t interval;			\
 		} c;						\
 								\
-		/* Timer watchers, time in milliseconds */	\
+		/* Timer watchers, time in nanoseconds */	\
 		struct {					\
-			int timeout;				\
-			int period;				\
+			uint64_t timeout;			\
+			uint64_t period;			\
+			uint64_t deadline;			\
+			int      flags;				\
 		} t;						\
+								\
+		/* Event watchers, bit in shared pending bitmap */ \
+		struct {					\
+			int slot;	/* Or -1, own eventfd */	\
+		} e;						\
+								\
+		/* Child process watchers */			\
+		struct {					\
+			pid_t pid;				\
+		} p;						\
+								\
+		/* File system watchers */			\
+		struct {					\
+			uint32_t mask;				\
+		} i;						\
+								\
+		/* File reader, and I/O on regular files */	\
+		struct {					\
+			off_t    size;				\
+			char    *buf;				\
+			int      own;				\
+		} f;						\
 	} u;							\
 								\
 	/* Watcher type */					\
 	uev_type_t
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /* Internal API for dealing with generic watchers */
 int _uev_watcher_init  (struct uev_ctx *ctx, struct uev *w, uev_type_t type,
 			void (*cb)(struct uev *, void *, int), void *arg,
 			int fd, int events);
 int _uev_watcher_start (struct uev *w);
 int _uev_watcher_stop  (struct uev *w);
+void _uev_watcher_drop (struct uev *w);
+#if !UEV_INLINE
 int _uev_watcher_active(struct uev *w);
+#endif
 int _uev_watcher_rearm (struct uev *w);
+int _uev_watcher_pause (struct uev *w, int events);
+
+/* Internal API for the context, see uev_invoke() */
+int _uev_owner         (struct uev_ctx *ctx);
+int _uev_invoke_init   (struct uev_ctx *ctx);
+void _uev_invoke_exit  (struct uev_ctx *ctx);
+
+/* Internal API for deadlines, driving the epoll_wait() timeout */
+int _uev_deadline_set  (struct uev *w, uint64_t due);
+void _uev_deadline_del (struct uev *w);
+
+/* Internal API for watcher types */
+int _uev_io_expire     (struct uev *w);
+#if UEV_HAVE_EVENT
+void _uev_event_exit   (struct uev_ctx *ctx);
+#endif
+#if UEV_HAVE_CHILD
+int _uev_child_reap    (struct uev *w);
+#endif
+#if UEV_HAVE_FSWATCH
+void _uev_fswatch_exit (struct uev_ctx *ctx);
+#endif
+#if UEV_HAVE_FILE
+int _uev_file_read     (struct uev *w);
+int _uev_file_eof      (struct uev *w);
+#endif
+#if UEV_HAVE_CO
+void _uev_co_exit      (struct uev_ctx *ctx);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* LIBUEV_PRIVATE_H_ */
 
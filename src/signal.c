@@ -51,27 +51,14 @@
  */
 int uev_signal_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int signo)
 {
-	sigset_t mask;
-	int fd;
-
-	if (!w || !ctx) {
-		errno = EINVAL;
+	if (_uev_watcher_init(ctx, w, UEV_SIGNAL_TYPE, cb, arg, -1, UEV_READ))
 		return -1;
-	}
-	w->fd = -1;
-
-	sigemptyset(&mask);
-	fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
-	if (fd < 0)
-		return -1;
-
-	if (_uev_watcher_init(ctx, w, UEV_SIGNAL_TYPE, cb, arg, fd, UEV_READ))
-		goto exit;
 
 	if (uev_signal_set(w, signo)) {
 		_uev_watcher_stop(w);
-	exit:
-		close(fd);
+		if (w->fd > -1)
+			close(w->fd);
+		w->fd = -1;
 		return -1;
 	}
 
@@ -88,6 +75,7 @@ int uev_signal_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int signo
 int uev_signal_set(uev_t *w, int signo)
 {
 	sigset_t mask;
+	int fd;
 
 	/* Every watcher must be registered to a context */
 	if (!w || !w->ctx) {
@@ -98,12 +86,6 @@ int uev_signal_set(uev_t *w, int signo)
 	/* Remember for callbacks and start/stop */
 	w->signo = signo;
 
-	/* Handle stopped signal watchers */
-	if (w->fd < 0) {
-		if (uev_signal_init(w->ctx, w, (uev_cb_t *)w->cb, w->arg, signo))
-			return -1;
-	}
-
 	sigemptyset(&mask);
 	sigaddset(&mask, signo);
 
@@ -112,8 +94,11 @@ int uev_signal_set(uev_t *w, int signo)
 	if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1)
 		return -1;
 
-	if (signalfd(w->fd, &mask, SFD_NONBLOCK) < 0)
+	/* Stopped signal watchers get a new descriptor */
+	fd = signalfd(w->fd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0)
 		return -1;
+	w->fd = fd;
 
 	return _uev_watcher_start(w);
 }
@@ -34,15 +34,23 @@
  */
 
 
-static void msec2tspec(int msec, struct timespec *ts)
+static void nsec2tspec(uint64_t nsec, struct timespec *ts)
 {
-	if (msec) {
-		ts->tv_sec  =  msec / 1000;
-		ts->tv_nsec = (msec % 1000) * 1000000;
-	} else {
-		ts->tv_sec  = 0;
-		ts->tv_nsec = 0;
-	}
+	ts->tv_sec  = nsec / 1000000000ULL;
+	ts->tv_nsec = nsec % 1000000000ULL;
+}
+
+/* Create timerfd for new, or stopped, timer watcher */
+static int timer_open(uev_t *w)
+{
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+	w->fd = fd;
+
+	return 0;
 }
 
 /**
@@ -71,29 +79,80 @@ static void msec2tspec(int msec, struct timespec *ts)
  * running, otherwise it is kept on hold until triggered by calling
  * uev_run().
  *
- * @see uev_timer_set
+ * @see uev_timer_set uev_hrtimer_init
  * @return POSIX OK(0) or non-zero with @p errno set on error.
  */
 int uev_timer_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int timeout, int period)
 {
-	int fd;
+	if (timeout < 0 || period < 0) {
+		errno = ERANGE;
+		return -1;
+	}
+
+	return uev_hrtimer_init(ctx, w, cb, arg, timeout * 1000000ULL, period * 1000000ULL, 0);
+}
 
+/**
+ * Reset a timer
+ * @param w        Watcher to reset
+ * @param timeout  Timeout in milliseconds before @p cb is called, zero disarms timer
+ * @param period   For periodic timers this is the period time that @p timeout is reset to
+ *
+ * Note, the @p timeout value must be non-zero.  Setting it to zero
+ * disarms the timer.  This is the behavior of the underlying Linux
+ * function [timerfd_settimer(2)](https://man7.org/linux/man-pages/man2/timerfd_settime.2.html)
+ *
+ * The @p timeout is relative to the cached loop time, uev_now(), not
+ * the time of the call.  Callbacks that run for a long time before
+ * setting a timer should call uev_now_update() first.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_timer_set(uev_t *w, int timeout, int period)
+{
 	if (timeout < 0 || period < 0) {
 		errno = ERANGE;
 		return -1;
 	}
 
-	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
-	if (fd < 0)
+	return uev_hrtimer_set(w, timeout * 1000000ULL, period * 1000000ULL, 0);
+}
+
+/**
+ * Create and start a high resolution timer watcher
+ * @param ctx      A valid libuEv context
+ * @param w        Pointer to an uev_t watcher
+ * @param cb       Callback function
+ * @param arg      Optional callback argument
+ * @param timeout  Timeout in nanoseconds before @p cb is called
+ * @param period   For periodic timers this is the period, in nanoseconds
+ * @param flags    Zero, or ::UEV_TIMER_ABSTIME
+ *
+ * Same as uev_timer_init() but with nanosecond resolution.  With the
+ * ::UEV_TIMER_ABSTIME flag @p timeout is an absolute CLOCK_MONOTONIC
+ * deadline, compare with uev_now(), instead of a relative timeout.
+ *
+ * Periodic timers are drift free, each expiry is scheduled by the
+ * kernel from the previous deadline, not from when the callback ran.
+ * When the event loop falls behind, expirations are not queued up,
+ * instead the callback is called once and uev::overrun holds the
+ * number of missed expirations.
+ *
+ * @see uev_hrtimer_set
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_hrtimer_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, uint64_t timeout, uint64_t period, int flags)
+{
+	if (_uev_watcher_init(ctx, w, UEV_TIMER_TYPE, cb, arg, -1, UEV_READ))
 		return -1;
+	w->overrun = 0;
 
-	if (_uev_watcher_init(ctx, w, UEV_TIMER_TYPE, cb, arg, fd, UEV_READ))
-		goto exit;
+	if (timer_open(w))
+		return -1;
 
-	if (uev_timer_set(w, timeout, period)) {
+	if (uev_hrtimer_set(w, timeout, period, flags)) {
 		_uev_watcher_stop(w);
-	exit:
-		close(fd);
+		close(w->fd);
 		w->fd = -1;
 		return -1;
 	}
@@ -102,18 +161,17 @@ int uev_timer_init(uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int timeou
 }
 
 /**
- * Reset a timer
+ * Reset a high resolution timer
  * @param w        Watcher to reset
- * @param timeout  Timeout in milliseconds before @p cb is called, zero disarms timer
- * @param period   For periodic timers this is the period time that @p timeout is reset to
+ * @param timeout  Timeout in nanoseconds, or absolute deadline, zero disarms timer
+ * @param period   For periodic timers this is the period, in nanoseconds
+ * @param flags    Zero, or ::UEV_TIMER_ABSTIME
  *
- * Note, the @p timeout value must be non-zero.  Setting it to zero
- * disarms the timer.  This is the behavior of the underlying Linux
- * function [timerfd_settimer(2)](https://man7.org/linux/man-pages/man2/timerfd_settime.2.html)
+ * Same as uev_timer_set() but with nanosecond resolution.
  *
  * @return POSIX OK(0) or non-zero with @p errno set on error.
  */
-int uev_timer_set(uev_t *w, int timeout, int period)
+int uev_hrtimer_set(uev_t *w, uint64_t timeout, uint64_t period, int flags)
 {
 	/* Every watcher must be registered to a context */
 	if (!w || !w->ctx) {
@@ -121,8 +179,8 @@ int uev_timer_set(uev_t *w, int timeout, int period)
 		return -1;
 	}
 
-	if (timeout < 0 || period < 0) {
-		errno = ERANGE;
+	if (flags & ~UEV_TIMER_ABSTIME) {
+		errno = EINVAL;
 		return -1;
 	}
 
@@ -132,19 +190,28 @@ int uev_timer_set(uev_t *w, int timeout, int period)
 		if (!timeout && !period)
 			return 0;
 
-		if (uev_timer_init(w->ctx, w, (uev_cb_t *)w->cb, w->arg, timeout, period))
+		if (timer_open(w))
 			return -1;
 	}
 
 	w->u.t.timeout = timeout;
 	w->u.t.period  = period;
+	w->u.t.flags   = flags;
+	w->u.t.deadline = 0;	/* Dormant until armed */
 
 	if (w->ctx->running) {
 		struct itimerspec time;
 
-		msec2tspec(timeout, &time.it_value);
-		msec2tspec(period, &time.it_interval);
-		if (timerfd_settime(w->fd, 0, &time, NULL) < 0)
+		/* Absolute deadline, from cached loop time, zero disarms */
+		if (timeout) {
+			w->u.t.deadline = timeout;
+			if (!(flags & UEV_TIMER_ABSTIME))
+				w->u.t.deadline += w->ctx->now;
+		}
+
+		nsec2tspec(w->u.t.deadline, &time.it_value);
+		nsec2tspec(period, &time.it_interval);
+		if (timerfd_settime(w->fd, TFD_TIMER_ABSTIME, &time, NULL) < 0)
 			return 1;
 	}
 
@@ -167,7 +234,7 @@ int uev_timer_start(uev_t *w)
 	if (-1 != w->fd)
 		_uev_watcher_stop(w);
 
-	return uev_timer_set(w, w->u.t.timeout, w->u.t.period);
+	return uev_hrtimer_set(w, w->u.t.timeout, w->u.t.period, w->u.t.flags);
 }
 
 /**
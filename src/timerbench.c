@@ -0,0 +1,282 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Timer scaling benchmark, creates N timer watchers and measures the
+ * cost per timer, in nanoseconds, of each operation:
+ *
+ *   init    uev_timer_init(), timerfd_create() and epoll_ctl(ADD)
+ *   set     uev_timer_set() on a disarmed timer
+ *   reset   uev_timer_set() on an armed timer, before it expires
+ *   stop    uev_timer_stop(), epoll_ctl(DEL) and close()
+ *   expire  dispatch of an expired timer, from epoll_wait() to callback
+ *
+ * RSS and number of open descriptors are sampled with all N timers
+ * armed.  Note, RSS does not include kernel memory for each timerfd.
+ * Output is CSV, one line per N, for plotting:
+ *
+ *     ./timerbench 1000 10000 100000 1000000 > timers.csv
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "uev.h"
+
+struct result {
+	double   init, set, reset, stop, expire;
+	long     rss;		/* KiB */
+	long     fds;
+};
+
+static uev_t *timers;
+static int num, fired;
+static uint64_t expire_end;
+static struct result res;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double per(uint64_t start)
+{
+	return (double)(now() - start) / num;
+}
+
+/* Resident set size in KiB, from /proc/self/statm */
+static long rss(void)
+{
+	long size, resident = 0;
+	FILE *fp;
+
+	fp = fopen("/proc/self/statm", "r");
+	if (!fp)
+		return -1;
+	if (fscanf(fp, "%ld %ld", &size, &resident) != 2)
+		resident = -1;
+	fclose(fp);
+
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Number of open descriptors, less the one used to count them */
+static long fds(void)
+{
+	struct dirent *d;
+	long n = -1;
+	DIR *dir;
+
+	dir = opendir("/proc/self/fd");
+	if (!dir)
+		return -1;
+	while ((d = readdir(dir))) {
+		if (d->d_name[0] != '.')
+			n++;
+	}
+	closedir(dir);
+
+	return n;
+}
+
+static int nofile(int n)
+{
+	struct rlimit rl;
+	rlim_t need = n + 64;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		return -1;
+	if (rl.rlim_cur >= need)
+		return 0;
+
+	rl.rlim_cur = need;
+	if (rl.rlim_max < need)
+		rl.rlim_max = need;
+
+	return setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static void expire_cb(uev_t *w, void *arg, int events)
+{
+	if (++fired == num)
+		expire_end = now();
+}
+
+static void nop_cb(uev_t *w, void *arg, int events)
+{
+}
+
+/*
+ * Runs from a callback, so timers are armed with timerfd_settime()
+ * right away, not when the event loop starts.  Leaves all timers
+ * expired, to be dispatched when we return to the event loop.
+ */
+static void bench_cb(uev_t *w, void *arg, int events)
+{
+	uev_ctx_t *ctx = w->ctx;
+	uint64_t start;
+	int i;
+
+	start = now();
+	for (i = 0; i < num; i++) {
+		if (uev_timer_init(ctx, &timers[i], nop_cb, NULL, 0, 0))
+			goto fail;
+	}
+	res.init = per(start);
+
+	start = now();
+	for (i = 0; i < num; i++)
+		uev_timer_set(&timers[i], 60000, 0);
+	res.set = per(start);
+
+	res.rss = rss();
+	res.fds = fds();
+
+	start = now();
+	for (i = 0; i < num; i++)
+		uev_timer_set(&timers[i], 61000, 0);
+	res.reset = per(start);
+
+	start = now();
+	for (i = 0; i < num; i++)
+		uev_timer_stop(&timers[i]);
+	res.stop = per(start);
+
+	/* Not measured, arm all for 1 ms and wait for the last to expire */
+	for (i = 0; i < num; i++) {
+		if (uev_timer_init(ctx, &timers[i], expire_cb, NULL, 1, 0))
+			goto fail;
+	}
+	uev_now_update(ctx);
+	usleep(2000);
+	expire_end = 0;
+	fired = 0;
+
+	*(uint64_t *)arg = now();
+	return;
+fail:
+	perror("uev_timer_init");
+	exit(1);
+}
+
+static int run(int n)
+{
+	uint64_t start = 0;
+	uev_ctx_t ctx;
+	uev_t w;
+
+	if (nofile(n)) {
+		fprintf(stderr, "Cannot raise RLIMIT_NOFILE to %d, skipping: %s\n",
+			n + 64, strerror(errno));
+		return 1;
+	}
+
+	timers = calloc(n, sizeof(uev_t));
+	if (!timers) {
+		perror("calloc");
+		return 1;
+	}
+	num = n;
+
+	if (uev_init(&ctx)) {
+		perror("uev_init");
+		return 1;
+	}
+	uev_hrtimer_init(&ctx, &w, bench_cb, &start, 1, 0, 0);
+	if (uev_run(&ctx, 0)) {
+		perror("uev_run");
+		return 1;
+	}
+	res.expire = (double)(expire_end - start) / num;
+	uev_exit(&ctx);
+	free(timers);
+
+	printf("%d,%.0f,%.0f,%.0f,%.0f,%.0f,%ld,%ld\n", n, res.init, res.set,
+	       res.reset, res.stop, res.expire, res.rss, res.fds);
+	fflush(stdout);
+
+	return 0;
+}
+
+static int usage(int rc)
+{
+	fprintf(stderr,
+		"Usage: timerbench [-h] [N ...]\n"
+		"\n"
+		"  -h  This help text\n"
+		"  N   Number of timers, default: 1000 10000 100000\n"
+		"\n"
+		"Output is CSV, time per timer is in nanoseconds, RSS in KiB.\n");
+
+	return rc;
+}
+
+int main(int argc, char *argv[])
+{
+	int counts[] = { 1000, 10000, 100000 };
+	int c, i, rc = 0;
+
+	while ((c = getopt(argc, argv, "h")) != -1) {
+		switch (c) {
+		case 'h':
+			return usage(0);
+		default:
+			return usage(1);
+		}
+	}
+
+	printf("timers,init_ns,set_ns,reset_ns,stop_ns,expire_ns,rss_kib,fds\n");
+	if (optind == argc) {
+		for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++)
+			rc |= run(counts[i]);
+
+		return rc;
+	}
+
+	for (i = optind; i < argc; i++) {
+		int n = atoi(argv[i]);
+
+		if (n <= 0)
+			return usage(1);
+		rc |= run(n);
+	}
+
+	return rc;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -28,154 +28,1178 @@
  */
 
 #include <errno.h>
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include <fcntl.h>		/* O_CLOEXEC */
+#include <limits.h>		/* INT_MAX */
+#include <stdlib.h>		/* realloc(), free() */
 #include <string.h>		/* memset() */
 #include <sys/epoll.h>
-#include <sys/ioctl.h>
-#include <sys/select.h>		/* for select() workaround */
 #include <sys/signalfd.h>	/* struct signalfd_siginfo */
+#include <sys/stat.h>		/* fstat() */
+#include <time.h>		/* clock_gettime() */
 #include <unistd.h>		/* close(), read() */
 
-#include "uev.h"
+#include "uev.h"
+
+
+static int _init(uev_ctx_t *ctx, int close_old)
+{
+	int fd;
+
+	fd = epoll_create1(EPOLL_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (close_old)
+		close(ctx->fd);
+
+	ctx->fd = fd;
+
+	return 0;
+}
+
+/* Epoll set for descriptor, UEV_PRIO_MAX watchers have their own set */
+static int _epfd(uev_ctx_t *ctx, int hi)
+{
+	struct epoll_event ev;
+	int fd;
+
+	if (!hi)
+		return ctx->fd;
+
+	if (ctx->hifd > -1)
+		return ctx->hifd;
+
+	fd = epoll_create1(EPOLL_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	/* The high priority set is nested in the main set */
+	ev.events  = EPOLLIN;
+	ev.data.fd = fd;
+	if (epoll_ctl(ctx->fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		close(fd);
+		return -1;
+	}
+	ctx->hifd = fd;
+
+	return fd;
+}
+
+/* Registry entry for descriptor, grown on demand */
+_UEV_HOT struct uev_fd *_fd(uev_ctx_t *ctx, int fd)
+{
+	struct uev_fd *fds;
+	int i, num;
+
+	if (fd < ctx->fdsz)
+		return &ctx->fds[fd];
+
+	num = ctx->fdsz ? ctx->fdsz : 64;
+	while (num <= fd)
+		num *= 2;
+
+	fds = realloc(ctx->fds, num * sizeof(*fds));
+	if (!fds)
+		return NULL;
+
+	for (i = ctx->fdsz; i < num; i++) {
+		fds[i].head   = NULL;
+		fds[i].events = 0;
+		fds[i].epfd   = -1;
+	}
+	ctx->fds  = fds;
+	ctx->fdsz = num;
+
+	return &fds[fd];
+}
+
+/* Add watcher last in its descriptor's list, dispatched in that order */
+static int _fd_link(uev_t *w)
+{
+	struct uev_fd *e;
+	uev_t **pw;
+
+	e = _fd(w->ctx, w->fd);
+	if (!e)
+		return -1;
+
+	for (pw = &e->head; *pw; pw = &(*pw)->fnext)
+		;
+	*pw = w;
+	w->fnext = NULL;
+
+	return 0;
+}
+
+static void _fd_unlink(uev_t *w)
+{
+	uev_t **pw;
+
+	for (pw = &w->ctx->fds[w->fd].head; *pw; pw = &(*pw)->fnext) {
+		if (*pw == w) {
+			*pw = w->fnext;
+			break;
+		}
+	}
+	w->fnext = NULL;
+}
+
+/*
+ * Register the union of all interests in a descriptor with the kernel,
+ * only changes cost a system call, unless @force, e.g., to rearm a
+ * one-shot descriptor.  Edge triggered and one-shot only if all of its
+ * watchers ask for it, the high priority set if any one of them does.
+ * Fired one-shot watchers add no interests until rearmed.
+ */
+static int _fd_sync(uev_ctx_t *ctx, int fd, int force)
+{
+	uint32_t events = 0, mode = EPOLLET | EPOLLONESHOT;
+	struct uev_fd *e = &ctx->fds[fd];
+	struct epoll_event ev;
+	int epfd, op, hi = 0;
+	uev_t *w;
+
+	if (!e->head) {
+		epfd = e->epfd;
+		e->epfd   = -1;
+		e->events = 0;
+		if (epfd < 0)
+			return 0;
+
+		return epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	}
+
+	for (w = e->head; w; w = w->fnext) {
+		if (!w->fired)
+			events |= w->events & ~(EPOLLET | EPOLLONESHOT | w->paused);
+		mode   &= w->events;
+		hi     |= w->prio == UEV_PRIO_MAX;
+	}
+	events |= mode | EPOLLRDHUP;
+
+	epfd = _epfd(ctx, hi);
+	if (epfd < 0)
+		return -1;
+
+	if (e->epfd == epfd && e->events == events && !force)
+		return 0;
+
+	op = EPOLL_CTL_MOD;
+	if (e->epfd != epfd) {
+		if (e->epfd > -1)
+			epoll_ctl(e->epfd, EPOLL_CTL_DEL, fd, NULL);
+		e->epfd = -1;
+		op = EPOLL_CTL_ADD;
+	}
+
+	ev.events  = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+		/* Closed and reused behind our back, kernel dropped it */
+		if (op != EPOLL_CTL_MOD || errno != ENOENT)
+			return -1;
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+			return -1;
+	}
+	e->epfd   = epfd;
+	e->events = events;
+
+	return 0;
+}
+
+/* Add watcher to the ready queue of its priority level */
+_UEV_HOT void _queue(uev_t *w, int events)
+{
+	w->revents |= events;
+	if (!w->rq)
+		_UEV_ENQUEUE(w, &w->ctx->ready[w->prio - UEV_PRIO_MIN]);
+}
+
+/* Fan out events on a descriptor to all its interested watchers */
+_UEV_HOT void _queue_fd(uev_ctx_t *ctx, struct epoll_event *ev)
+{
+	int fd = ev->data.fd, fired = 0, armed = 0;
+	uint32_t events;
+	struct uev_fd *e;
+	uev_t *w;
+
+	if (fd >= ctx->fdsz)
+		return;
+
+	e = &ctx->fds[fd];
+	for (w = e->head; w; w = w->fnext) {
+		if (w->fired)
+			continue;
+
+		events = ev->events & ((w->events & ~w->paused) | EPOLLERR | EPOLLHUP | EPOLLRDHUP);
+		if (events) {
+			_queue(w, events);
+
+			/* Disarmed until rearmed by uev_io_set() */
+			if (w->events & UEV_ONESHOT) {
+				w->fired = 1;
+				fired++;
+				continue;
+			}
+		}
+		armed++;
+	}
+
+	/*
+	 * The kernel only disarms a descriptor if all its watchers are
+	 * one-shot.  Otherwise drop the interests of the fired ones, or
+	 * rearm the descriptor for those still waiting.
+	 */
+	if (!fired)
+		return;
+
+	if (!(e->events & EPOLLONESHOT))
+		_fd_sync(ctx, fd, 0);
+	else if (armed)
+		_fd_sync(ctx, fd, 1);
+}
+
+/* Get next watcher to dispatch, highest priority first */
+_UEV_HOT uev_t *_unqueue(uev_ctx_t *ctx)
+{
+	int i;
+
+	for (i = _UEV_PRIO_LEVELS - 1; i >= 0; i--) {
+		struct uev_queue *q = &ctx->ready[i];
+		uev_t *w = q->head;
+
+		if (w) {
+			_UEV_DEQUEUE(w, q);
+			return w;
+		}
+	}
+
+	return NULL;
+}
+
+/* Busy poll window, adapts to the average time between wakeups */
+static uint64_t _spin(uev_ctx_t *ctx)
+{
+	uint64_t max = ctx->busy_us * 1000ULL;
+
+	/* Idle loop, events arrive too seldom to spin for */
+	if (ctx->busy_avg > max)
+		return 0;
+
+	if (2 * ctx->busy_avg < max)
+		return 2 * ctx->busy_avg;
+
+	return max;
+}
+
+/* Update average time between wakeups with events, EWMA 1/8 */
+static void _arrival(uev_ctx_t *ctx)
+{
+	int64_t delta = ctx->now - ctx->busy_last - ctx->busy_avg;
+
+	ctx->busy_avg += delta / 8;
+	ctx->busy_last = ctx->now;
+}
+
+/* Wait for events, timeout in nanoseconds, or -1 to block */
+static int _wait(int fd, struct epoll_event *ee, int maxevents, int64_t timeout)
+{
+#ifdef HAVE_EPOLL_PWAIT2
+	static int nosys = 0;
+
+	if (!nosys) {
+		struct timespec ts, *tsp = NULL;
+		int nfds;
+
+		if (timeout >= 0) {
+			ts.tv_sec  = timeout / 1000000000LL;
+			ts.tv_nsec = timeout % 1000000000LL;
+			tsp = &ts;
+		}
+
+		nfds = epoll_pwait2(fd, ee, maxevents, tsp, NULL);
+		if (nfds >= 0 || errno != ENOSYS)
+			return nfds;
+
+		/* Kernel < 5.11, fall back to milliseconds */
+		nosys = 1;
+	}
+#endif
+	/* Round up, never return before the timeout */
+	if (timeout > 0)
+		timeout = (timeout + 999999) / 1000000;
+
+	return epoll_wait(fd, ee, maxevents, timeout > INT_MAX ? INT_MAX : (int)timeout);
+}
+
+/* Wait for events, the high priority set is always polled first */
+static int _poll(uev_ctx_t *ctx, struct epoll_event *ee, int maxevents, int64_t timeout)
+{
+	uint64_t end;
+	int nfds;
+
+	if (ctx->hifd > -1) {
+		nfds = epoll_wait(ctx->hifd, ee, maxevents, 0);
+		if (nfds)
+			return nfds;
+	}
+
+	/* Spin before blocking, see uev_busypoll_set() */
+	if (timeout && ctx->busy_us) {
+		uint64_t spin = _spin(ctx);
+
+		if (timeout > 0 && (uint64_t)timeout < spin)
+			spin = timeout;
+
+		uev_now_update(ctx);
+		end = ctx->now + spin;
+		while (ctx->now < end) {
+			nfds = epoll_wait(ctx->fd, ee, maxevents, 0);
+			if (nfds)
+				return nfds;
+			uev_now_update(ctx);
+		}
+
+		if (timeout > 0)
+			timeout -= spin;
+	}
+
+	return _wait(ctx->fd, ee, maxevents, timeout);
+}
+
+/* High priority set became ready while waiting in the main set */
+static void _poll_hi(uev_ctx_t *ctx, int maxevents)
+{
+	struct epoll_event ee[UEV_MAX_EVENTS];
+	int i, nfds;
+
+	nfds = epoll_wait(ctx->hifd, ee, maxevents, 0);
+	for (i = 0; i < nfds; i++)
+		_queue_fd(ctx, &ee[i]);
+}
+
+/* Move requeued watchers to the tail of their ready queue */
+_UEV_HOT int _requeue(uev_ctx_t *ctx)
+{
+	int i, num = 0;
+	uev_t *w;
+
+	while ((w = ctx->again.head)) {
+		_UEV_DEQUEUE(w, &ctx->again);
+		_queue(w, 0);
+	}
+
+	for (i = 0; i < _UEV_PRIO_LEVELS; i++)
+		num += ctx->ready[i].head != NULL;
+
+	return num;
+}
+
+/* Move heap entry up, or down, to its place and update its index */
+static void _heap_place(uev_ctx_t *ctx, int i, uev_t *w)
+{
+	uev_t **heap = ctx->heap;
+
+	while (i > 1 && heap[i / 2]->due > w->due) {
+		heap[i] = heap[i / 2];
+		heap[i]->hidx = i;
+		i /= 2;
+	}
+
+	while (2 * i <= ctx->heapcnt) {
+		int c = 2 * i;
+
+		if (c < ctx->heapcnt && heap[c + 1]->due < heap[c]->due)
+			c++;
+		if (w->due <= heap[c]->due)
+			break;
+
+		heap[i] = heap[c];
+		heap[i]->hidx = i;
+		i = c;
+	}
+
+	heap[i] = w;
+	w->hidx = i;
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_deadline_set(uev_t *w, uint64_t due)
+{
+	uev_ctx_t *ctx = w->ctx;
+
+	if (!w->hidx) {
+		if (ctx->heapcnt + 1 >= ctx->heapsz) {
+			int num = ctx->heapsz ? 2 * ctx->heapsz : 64;
+			uev_t **heap;
+
+			heap = realloc(ctx->heap, num * sizeof(*heap));
+			if (!heap)
+				return -1;
+			ctx->heap   = heap;
+			ctx->heapsz = num;
+		}
+		w->hidx = ++ctx->heapcnt;
+	}
+
+	w->due = due;
+	_heap_place(ctx, w->hidx, w);
+
+	return 0;
+}
+
+/* Private to libuEv, do not use directly! */
+void _uev_deadline_del(uev_t *w)
+{
+	uev_ctx_t *ctx = w->ctx;
+	uev_t *last;
+	int i = w->hidx;
+
+	if (!i)
+		return;
+
+	w->hidx = 0;
+	last = ctx->heap[ctx->heapcnt--];
+	if (last != w)
+		_heap_place(ctx, i, last);
+}
+
+/* Time constant of loop utilisation EWMA, nsec */
+#define _UEV_LAG_TAU  1000000000ULL
+
+static uint64_t _monotonic(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Lateness of a timer, or deadline, EWMA with alpha 1/8 like TCP RTT */
+static void _lag(uev_ctx_t *ctx, uint64_t now, uint64_t due)
+{
+	uint64_t lag = now > due ? now - due : 0;
+
+	if (lag > ctx->lag.peak)
+		ctx->lag.peak = lag;
+	ctx->lag.lag = (int64_t)ctx->lag.lag + ((int64_t)lag - (int64_t)ctx->lag.lag) / 8;
+}
+
+/*
+ * Loop woken up, update utilisation with the time busy since the last
+ * wakeup, and call the hook if a threshold is crossed.  Hysteresis of
+ * 1/4 of the thresholds, so the hook does not flap.
+ */
+static void _load(uev_ctx_t *ctx)
+{
+	uint64_t wake = ctx->now;
+	int over, under;
+
+	if (ctx->lag.wake && wake > ctx->lag.wake && ctx->lag.sleep >= ctx->lag.wake) {
+		double dt   = wake - ctx->lag.wake;
+		double busy = (ctx->lag.sleep - ctx->lag.wake) / dt;
+
+		ctx->lag.util += (busy - ctx->lag.util) * dt / (_UEV_LAG_TAU + dt);
+	}
+	ctx->lag.wake = wake;
+
+	over  = (ctx->lag.max_lag  && ctx->lag.lag  > ctx->lag.max_lag) ||
+		(ctx->lag.max_util && ctx->lag.util > ctx->lag.max_util);
+	under = (!ctx->lag.max_lag  || ctx->lag.lag  < ctx->lag.max_lag * 3 / 4) &&
+		(!ctx->lag.max_util || ctx->lag.util < ctx->lag.max_util * 3 / 4);
+
+	if (!ctx->lag.overload && over)
+		ctx->lag.overload = 1;
+	else if (ctx->lag.overload && under)
+		ctx->lag.overload = 0;
+	else
+		return;
+
+	if (ctx->lag.cb)
+		ctx->lag.cb(ctx, ctx->lag.arg, ctx->lag.overload);
+}
+
+/* Call watchers with expired deadlines, earliest first */
+static void _expire(uev_ctx_t *ctx)
+{
+	uev_t *w;
+
+	while (ctx->heapcnt && ctx->heap[1]->due <= ctx->now) {
+		w = ctx->heap[1];
+		_uev_deadline_del(w);
+		if (ctx->lag.on)
+			_lag(ctx, ctx->now, w->due);
+
+		if (w->type == UEV_IO_TYPE) {
+			int events = _uev_io_expire(w);
+
+			if (events)
+				_queue(w, events);
+		}
+	}
+}
+
+/* Number of fork() this process is from, the loop owner is not in a child */
+static unsigned int forks;
+static pthread_once_t forks_once = PTHREAD_ONCE_INIT;
+
+static void _forked(void)
+{
+	forks++;
+}
+
+/*
+ * Registered on first uev_init(), not from a constructor, so a library
+ * that is only dlopen()ed never leaves a handler behind.  GLIBC drops
+ * it on dlclose(), with other C libraries libuEv must not be unloaded
+ * once it has been used.
+ */
+static void _atfork(void)
+{
+	pthread_atfork(NULL, NULL, _forked);
+}
+
+/*
+ * Private to libuEv, do not use directly!  Called in the loop's thread?
+ * Any thread may call this, relaxed atomics are enough since only the
+ * loop's own thread can see itself as owner, in its own stores.
+ */
+int _uev_owner(uev_ctx_t *ctx)
+{
+	pthread_t owner;
+
+	if (!__atomic_load_n(&ctx->owned, __ATOMIC_RELAXED))
+		return 0;
+
+	__atomic_load(&ctx->owner, &owner, __ATOMIC_RELAXED);
+	return __atomic_load_n(&ctx->forks, __ATOMIC_RELAXED) == forks &&
+		pthread_equal(owner, pthread_self());
+}
+
+/* Set, or clear, calling thread as owner of the loop, see _uev_owner() */
+static void _own(uev_ctx_t *ctx, int owned)
+{
+	pthread_t self = pthread_self();
+
+	if (owned) {
+		__atomic_store(&ctx->owner, &self, __ATOMIC_RELAXED);
+		__atomic_store_n(&ctx->forks, forks, __ATOMIC_RELAXED);
+	}
+	__atomic_store_n(&ctx->owned, owned, __ATOMIC_RELAXED);
+}
+
+/* Thread CPU time in nanoseconds, for profiling */
+static uint64_t _cputime(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts))
+		return 0;
+
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Charge CPU time spent in callback so far, before watcher may be freed */
+static void _charge(uev_ctx_t *ctx)
+{
+	uev_t *w = ctx->prof_w;
+
+	ctx->prof_w = NULL;
+	w->prof.cpu += _cputime() - ctx->prof_cpu;
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_watcher_init(uev_ctx_t *ctx, uev_t *w, uev_type_t type, uev_cb_t *cb, void *arg, int fd, int events)
+{
+	if (!ctx || !w) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	w->ctx     = ctx;
+	w->type    = type;
+	w->active  = 0;
+	w->fd      = fd;
+	w->cb      = cb;
+	w->arg     = arg;
+	w->events  = events;
+	w->prio    = 0;
+	w->revents = 0;
+	w->rnext   = NULL;
+	w->rprev   = NULL;
+	w->rq      = NULL;
+	w->paused  = 0;
+	w->fired   = 0;
+	w->posted  = 0;
+	w->hidx    = 0;
+	w->tb.rate = 0;
+	w->idle    = 0;
+	memset(&w->prof, 0, sizeof(w->prof));
+
+	return 0;
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_watcher_start(uev_t *w)
+{
+
+	if (!w || w->fd < 0 || !w->ctx) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (_uev_watcher_active(w))
+		return 0;
+
+	if (w->type == UEV_FILE_TYPE)
+		goto queued;
+
+	if (_fd_link(w))
+		return -1;
+
+	if (_fd_sync(w->ctx, w->fd, 0)) {
+		struct stat st;
+		int err = errno;
+
+		_fd_unlink(w);
+		_fd_sync(w->ctx, w->fd, 0);
+		errno = err;
+		if (errno != EPERM)
+			return -1;
+
+		/* Handle special case: `application < file.txt` */
+		if (!UEV_HAVE_FILE || w->type != UEV_IO_TYPE || w->events != UEV_READ)
+			return -1;
+
+		/* Regular files, or stdin, e.g., /dev/null, never directories */
+		if (fstat(w->fd, &st) || S_ISDIR(st.st_mode) ||
+		    (!S_ISREG(st.st_mode) && w->fd != STDIN_FILENO)) {
+			errno = EPERM;
+			return -1;
+		}
+
+		w->u.f.size = 0;
+		posix_fadvise(w->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	queued:
+		/* Always readable, dispatched from the ready queue */
+		w->active   = _UEV_QUEUED;
+		w->revents |= UEV_READ;
+		if (!w->rq)
+			_UEV_ENQUEUE(w, &w->ctx->again);
+	} else {
+		w->active = 1;
+	}
+
+	/* Add to internal list for bookkeeping */
+	_UEV_INSERT(w, w->ctx->watchers);
+
+	return 0;
+}
+
+/*
+ * Private to libuEv, do not use directly!  Drop any events not yet
+ * dispatched, and any deadline, of an active watcher being stopped.
+ */
+void _uev_watcher_drop(uev_t *w)
+{
+	/* Stopped in its own callback, may be freed next */
+	if (w->ctx->prof_w == w)
+		_charge(w->ctx);
+
+	if (w->rq)
+		_UEV_DEQUEUE(w, w->rq);
+	w->revents = 0;
+	w->posted  = 0;
+	if (w->hidx)
+		_uev_deadline_del(w);
+	w->paused = 0;
+	w->fired  = 0;
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_watcher_stop(uev_t *w)
+{
+	if (!w) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* The context may be gone, e.g., after uev_exit() */
+	if (!_uev_watcher_active(w))
+		return 0;
+
+	_uev_watcher_drop(w);
+
+	/* Remove from internal list */
+	_UEV_REMOVE(w, w->ctx->watchers);
+	if (w->active == _UEV_QUEUED) {
+		w->active = 0;
+		return 0;
+	}
+	w->active = 0;
+
+	/* Remove from kernel, or only our interests if fd is shared */
+	_fd_unlink(w);
+	if (_fd_sync(w->ctx, w->fd, 0))
+		return -1;
+
+	return 0;
+}
+
+#if !UEV_INLINE
+/* Private to libuEv, do not use directly! */
+int _uev_watcher_active(uev_t *w)
+{
+	if (!w)
+		return 0;
+
+	return w->active > 0;
+}
+#endif
+
+/* Private to libuEv, do not use directly! */
+int _uev_watcher_rearm(uev_t *w)
+{
+	if (!w || w->fd < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* Not in kernel, dispatch again next iteration */
+	if (w->active == _UEV_QUEUED) {
+		w->revents |= UEV_READ;
+		if (!w->rq)
+			_UEV_ENQUEUE(w, &w->ctx->again);
+		return 0;
+	}
+
+	if (w->active != 1) {
+		errno = EINVAL;
+		return -1;
+	}
+	w->fired = 0;
+
+	return _fd_sync(w->ctx, w->fd, 1);
+}
+
+/* Private to libuEv, do not use directly! */
+int _uev_watcher_pause(uev_t *w, int events)
+{
+	if (w->paused == events)
+		return 0;
+
+	w->paused = events;
+	if (w->active != 1)
+		return 0;
 
+	return _fd_sync(w->ctx, w->fd, 0);
+}
 
-static int _init(uev_ctx_t *ctx, int close_old)
+/**
+ * Set watcher priority
+ * @param w     Pointer to an initialized uev_t watcher
+ * @param prio  Priority, ::UEV_PRIO_MIN (lowest) to ::UEV_PRIO_MAX (highest)
+ *
+ * Events that are ready in the same loop iteration are dispatched in
+ * priority order, highest first, and in kernel order within the same
+ * priority.  The default priority is zero.
+ *
+ * Watchers with ::UEV_PRIO_MAX are kept in a separate epoll set, which
+ * is always polled before the other watchers.  This way latency
+ * critical watchers, e.g., a control socket or a watchdog timer, can
+ * be served even when bulk traffic fills the event cache.
+ *
+ * The priority is kept when a watcher is stopped and started again,
+ * the watcher's _init() function resets it to zero.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_prio_set(uev_t *w, int prio)
 {
-	int fd;
+	if (!w || !w->ctx) {
+		errno = EINVAL;
+		return -1;
+	}
 
-	fd = epoll_create1(EPOLL_CLOEXEC);
-	if (fd < 0)
+	if (prio < UEV_PRIO_MIN || prio > UEV_PRIO_MAX) {
+		errno = ERANGE;
 		return -1;
+	}
 
-	if (close_old)
-		close(ctx->fd);
+	/* Requeue any pending events at the new priority level */
+	if (w->rq)
+		_UEV_DEQUEUE(w, w->rq);
+	w->prio = prio;
+	if (w->revents || w->posted)
+		_queue(w, 0);
 
-	ctx->fd = fd;
+	/* Move active descriptor to the other epoll set? */
+	if (w->active == 1)
+		return _fd_sync(w->ctx, w->fd, 0);
 
 	return 0;
 }
 
-/* Used by file i/o workaround when epoll => EPERM */
-static int has_data(int fd)
+/**
+ * Set dispatch budget per loop iteration
+ * @param ctx        A valid libuEv context
+ * @param callbacks  Max number of callbacks per iteration, or zero
+ * @param usec       Max time in microseconds spent in callbacks, or zero
+ *
+ * By default all ready watchers are dispatched in each loop iteration.
+ * With a budget, libuEv stops dispatching when either limit is reached
+ * and carries the remaining ready watchers over to the next iteration,
+ * before any new events are waited for.  Nothing is lost, the watchers
+ * keep their place in the ready list.  The time limit reads the clock
+ * after each callback, without updating uev_now().
+ *
+ * Combine with uev_io_requeue() in callbacks that drain fast peers, to
+ * get fair service across many connections.  Zero disables a limit.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_budget_set(uev_ctx_t *ctx, int callbacks, int usec)
 {
-	struct timeval timeout = { 0, 0 };
-	fd_set fds;
-	int n = 0;
+	if (!ctx) {
+		errno = EINVAL;
+		return -1;
+	}
 
-	FD_ZERO(&fds);
-	FD_SET(fd, &fds);
+	if (callbacks < 0 || usec < 0) {
+		errno = ERANGE;
+		return -1;
+	}
 
-	if (select(1, &fds, NULL, NULL, &timeout) > 0)
-		return ioctl(0, FIONREAD, &n) == 0 && n > 0;
+	ctx->budget    = callbacks;
+	ctx->budget_us = usec;
 
 	return 0;
 }
 
-/* Private to libuEv, do not use directly! */
-int _uev_watcher_init(uev_ctx_t *ctx, uev_t *w, uev_type_t type, uev_cb_t *cb, void *arg, int fd, int events)
+/**
+ * Set adaptive busy poll window
+ * @param ctx   A valid libuEv context
+ * @param usec  Max time in microseconds to spin before blocking, or zero
+ *
+ * For ultra low latency applications the cost of going to sleep in the
+ * kernel, and being woken up again, in epoll_wait() can dominate the
+ * end-to-end latency.  With busy polling the event loop first spins,
+ * polling without blocking, before it falls back to a blocking wait.
+ *
+ * The spin window adapts to the average time between wakeups, it is
+ * twice the average, at most @p usec.  If events arrive less often
+ * than @p usec the loop does not spin at all, so an idle loop does not
+ * burn any CPU.  Zero disables busy polling, which is the default.
+ *
+ * Note: only useful if the thread running the event loop, and the one
+ *       producing the events, have a CPU core each.  See the pingpong
+ *       benchmark, in the `src/` directory, to measure the effect.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_busypoll_set(uev_ctx_t *ctx, int usec)
 {
-	if (!ctx || !w) {
+	if (!ctx) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	w->ctx    = ctx;
-	w->type   = type;
-	w->active = 0;
-	w->fd     = fd;
-	w->cb     = cb;
-	w->arg    = arg;
-	w->events = events;
+	if (usec < 0) {
+		errno = ERANGE;
+		return -1;
+	}
+
+	ctx->busy_us   = usec;
+	ctx->busy_avg  = usec * 1000ULL / 2;
+	ctx->busy_last = ctx->now;
 
 	return 0;
 }
 
-/* Private to libuEv, do not use directly! */
-int _uev_watcher_start(uev_t *w)
+/**
+ * Enable per-watcher profiling counters
+ * @param ctx     A valid libuEv context
+ * @param enable  Non-zero to enable, zero to disable
+ *
+ * When a daemon burns CPU it is not obvious which of its watchers are
+ * responsible.  With profiling enabled the event loop counts, for each
+ * watcher, the number of callbacks, the CPU time spent in them, the
+ * loop time of the last callback, and spurious wakeups.  Use
+ * uev_stat_next() to read the counters, e.g., on SIGUSR1 or from a
+ * timer, and sort them to find the most costly watchers.
+ *
+ * CPU time is read from CLOCK_THREAD_CPUTIME_ID, so it only includes
+ * time in the thread running the event loop.  That is two extra calls
+ * to clock_gettime() per callback, in the vDSO, which is why this is
+ * disabled by default.  A callback that stops its own watcher is only
+ * charged up to the uev_*_stop() call, since the watcher may be freed
+ * after that.  The last callback of a watcher stopped by the event
+ * loop, e.g., a one-shot timer, is counted but not charged CPU time.
+ *
+ * Counters are kept when profiling is disabled, they are cleared when
+ * the watcher is initialized, by its _init() function.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_profile_set(uev_ctx_t *ctx, int enable)
 {
-	struct epoll_event ev;
-
-	if (!w || w->fd < 0 || !w->ctx) {
+	if (!ctx) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (_uev_watcher_active(w))
-		return 0;
+	ctx->profile = enable ? 1 : 0;
 
-	ev.events   = w->events | EPOLLRDHUP;
-	ev.data.ptr = w;
-	if (epoll_ctl(w->ctx->fd, EPOLL_CTL_ADD, w->fd, &ev) < 0) {
-		if (errno != EPERM)
-			return -1;
+	return 0;
+}
 
-		/* Handle special case: `application < file.txt` */
-		if (w->type != UEV_IO_TYPE || w->events != UEV_READ)
-			return -1;
+/**
+ * Count a spurious wakeup
+ * @param w  Pointer to an initialized watcher
+ *
+ * A callback that was woken up but had nothing to do, e.g., read()
+ * returned EAGAIN because another thread, or process, got to the data
+ * first, should call this to have it counted.  libuEv counts this for
+ * its own descriptors, e.g., timers rearmed after epoll_wait().  Only
+ * counted when profiling is enabled, see uev_profile_set().
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_stat_spurious(uev_t *w)
+{
+	if (!w || !w->ctx) {
+		errno = EINVAL;
+		return -1;
+	}
 
-		/* Only allow this special handling for stdin */
-		if (w->fd != STDIN_FILENO)
-			return -1;
+	if (w->ctx->profile)
+		w->prof.spurious++;
 
-		w->ctx->workaround = 1;
-		w->active = -1;
-	} else {
-		w->active = 1;
+	return 0;
+}
+
+/**
+ * Iterate over active watchers, with profiling counters
+ * @param ctx  A valid libuEv context
+ * @param w    Previous watcher, or NULL to get the first one
+ * @param st   Pointer to a struct uev_stat, filled in for the watcher
+ *
+ * Returns the next active watcher in @p ctx after @p w and fills in @p st
+ * with its type, descriptor, requested events, and profiling counters,
+ * see uev_profile_set().  The order is unspecified.  File system
+ * watchers are not listed, only their shared inotify descriptor, as an
+ * io watcher.  Watchers must not be started or stopped while iterating,
+ * except that the one last returned may be stopped:
+ *
+ *     for (w = uev_stat_next(ctx, NULL, &st); w; w = uev_stat_next(ctx, w, &st))
+ *             printf("%-8s %3d %8llu\n", st.type, st.fd, st.count);
+ *
+ * @return Next watcher, or NULL when done, or on error with @p errno set.
+ */
+uev_t *uev_stat_next(uev_ctx_t *ctx, uev_t *w, struct uev_stat *st)
+{
+	static const char *types[] = {
+		[UEV_IO_TYPE]      = "io",
+		[UEV_SIGNAL_TYPE]  = "signal",
+		[UEV_TIMER_TYPE]   = "timer",
+		[UEV_CRON_TYPE]    = "cron",
+		[UEV_EVENT_TYPE]   = "event",
+		[UEV_CHILD_TYPE]   = "child",
+		[UEV_FSWATCH_TYPE] = "fswatch",
+		[UEV_FILE_TYPE]    = "file",
+	};
+
+	if (!ctx || !st || (w && w->ctx != ctx)) {
+		errno = EINVAL;
+		return NULL;
 	}
 
-	/* Add to internal list for bookkeeping */
-	_UEV_INSERT(w, w->ctx->watchers);
+	/* Last returned watcher stopped, its next was saved */
+	if (!w)
+		w = ctx->watchers;
+	else if (!_uev_watcher_active(w) && w == ctx->stat_w)
+		w = ctx->stat_next;
+	else
+		w = w->next;
+
+	ctx->stat_w    = w;
+	ctx->stat_next = w ? w->next : NULL;
+	if (!w)
+		return NULL;
 
-	return 0;
+	st->type     = types[w->type];
+	st->fd       = w->fd;
+	st->events   = w->events;
+	st->count    = w->prof.count;
+	st->cpu      = w->prof.cpu;
+	st->last     = w->prof.last;
+	st->spurious = w->prof.spurious;
+
+	return w;
 }
 
-/* Private to libuEv, do not use directly! */
-int _uev_watcher_stop(uev_t *w)
+/**
+ * Set loop lag monitor and overload hook
+ * @param ctx     A valid libuEv context
+ * @param lag_us  Max timer lag in microseconds, or zero
+ * @param util    Max loop utilisation in percent, 1-100, or zero
+ * @param cb      Optional hook, called when a threshold is crossed
+ * @param arg     Optional argument to @p cb
+ *
+ * An event loop that falls behind shows it in two ways: timers fire
+ * late, and the loop is busy in callbacks most of the time.  The lag
+ * monitor tracks both, the lag of timers, scheduled versus actual
+ * expiration, and the utilisation, time in callbacks versus wall time,
+ * as exponentially weighted moving averages.  The lag is averaged over
+ * the last eight or so timers, the utilisation has a time constant of
+ * one second.  Timer lag includes idle timeouts and rate limit refills
+ * on I/O watchers, so a context without any timers may use those.
+ *
+ * When the lag, or utilisation, is above its threshold the hook is
+ * called with @p overload set to 1, before the watchers in that loop
+ * iteration are called, so the application can, e.g., stop accepting
+ * new connections or reading from existing ones, before its queues
+ * explode.  When both are below 3/4 of their thresholds again the hook
+ * is called with @p overload set to 0.  A zero threshold is not used.
+ *
+ * The monitor is enabled when a threshold, or hook, is set and costs
+ * one call to clock_gettime(), in the vDSO, per loop iteration and one
+ * per timer.  Call with all zero, and NULL, to disable.  See also
+ * uev_lag_get().
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_lag_set(uev_ctx_t *ctx, int lag_us, int util, uev_lag_cb_t *cb, void *arg)
 {
-	if (!w) {
+	if (!ctx) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	if (!_uev_watcher_active(w))
-		return 0;
+	if (lag_us < 0 || util < 0 || util > 100) {
+		errno = ERANGE;
+		return -1;
+	}
 
-	w->active = 0;
+	ctx->lag.on       = lag_us || util || cb;
+	ctx->lag.max_lag  = lag_us * 1000ULL;
+	ctx->lag.max_util = util / 100.0;
+	ctx->lag.cb       = cb;
+	ctx->lag.arg      = arg;
+	ctx->lag.wake     = 0;
 
-	/* Remove from internal list */
-	_UEV_REMOVE(w, w->ctx->watchers);
+	return 0;
+}
 
-	/* Remove from kernel */
-	if (epoll_ctl(w->ctx->fd, EPOLL_CTL_DEL, w->fd, NULL) < 0)
+/**
+ * Get loop lag and utilisation
+ * @param ctx  A valid libuEv context
+ * @param lag  Pointer to a struct uev_lag, filled in
+ *
+ * Reads the current averages of the lag monitor, see uev_lag_set(),
+ * e.g., for metrics.  The peak timer lag is reset by each call.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_lag_get(uev_ctx_t *ctx, struct uev_lag *lag)
+{
+	if (!ctx || !lag) {
+		errno = EINVAL;
 		return -1;
+	}
+
+	lag->lag      = ctx->lag.lag;
+	lag->peak     = ctx->lag.peak;
+	lag->util     = (int)(ctx->lag.util * 100 + 0.5);
+	lag->overload = ctx->lag.overload;
+	ctx->lag.peak = 0;
 
 	return 0;
 }
 
-/* Private to libuEv, do not use directly! */
-int _uev_watcher_active(uev_t *w)
+/**
+ * Cached loop time
+ * @param ctx  A valid libuEv context
+ *
+ * The event loop samples CLOCK_MONOTONIC once per wakeup, before any
+ * callbacks are called.  This function returns that time, without any
+ * system call, which is useful to time stamp requests and calculate
+ * deadlines in callbacks.  All callbacks in the same iteration see the
+ * same time.  Call uev_now_update() after long running operations.
+ *
+ * Timers are armed relative to this time, see uev_timer_set().
+ *
+ * @return Monotonic time in nanoseconds, or zero on error.
+ */
+uint64_t uev_now(uev_ctx_t *ctx)
 {
-	if (!w)
+	if (!ctx) {
+		errno = EINVAL;
 		return 0;
+	}
 
-	return w->active > 0;
+	return ctx->now;
 }
 
-/* Private to libuEv, do not use directly! */
-int _uev_watcher_rearm(uev_t *w)
+/**
+ * Cached wall clock time
+ * @param ctx  A valid libuEv context
+ *
+ * Same as uev_now() but for CLOCK_REALTIME.  The wall clock is only
+ * sampled on demand, at most once per wakeup, i.e., the first call in
+ * an iteration reads the clock and the remaining ones are cached.
+ *
+ * @return Time since the Epoch in nanoseconds, or zero on error.
+ */
+uint64_t uev_now_real(uev_ctx_t *ctx)
 {
-	struct epoll_event ev;
+	struct timespec ts;
 
-	if (!w || w->fd < 0) {
+	if (!ctx) {
+		errno = EINVAL;
+		return 0;
+	}
+
+	if (!ctx->now_real) {
+		if (clock_gettime(CLOCK_REALTIME, &ts))
+			return 0;
+		ctx->now_real = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	}
+
+	return ctx->now_real;
+}
+
+/**
+ * Update cached loop time
+ * @param ctx  A valid libuEv context
+ *
+ * Samples CLOCK_MONOTONIC for uev_now() and invalidates the cached
+ * CLOCK_REALTIME.  Called automatically by the event loop on every
+ * wakeup.
+ *
+ * @return POSIX OK(0) or non-zero with @p errno set on error.
+ */
+int uev_now_update(uev_ctx_t *ctx)
+{
+	struct timespec ts;
+
+	if (!ctx) {
 		errno = EINVAL;
 		return -1;
 	}
 
-	ev.events   = w->events | EPOLLRDHUP;
-	ev.data.ptr = w;
-	if (epoll_ctl(w->ctx->fd, EPOLL_CTL_MOD, w->fd, &ev) < 0)
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
 		return -1;
 
+	ctx->now      = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	ctx->now_real = 0;
+
 	return 0;
 }
 
@@ -225,8 +1249,12 @@ int uev_init1(uev_ctx_t *ctx, int maxevents)
 	if (maxevents > UEV_MAX_EVENTS)
 		maxevents = UEV_MAX_EVENTS;
 
+	pthread_once(&forks_once, _atfork);
+
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->maxevents = maxevents;
+	ctx->hifd      = -1;
+	uev_now_update(ctx);
 
 	return _init(ctx, 0);
 }
@@ -258,23 +1286,63 @@ int uev_exit(uev_ctx_t *ctx)
 			uev_io_stop(w);
 			break;
 
+#if UEV_HAVE_SIGNAL
 		case UEV_SIGNAL_TYPE:
 			uev_signal_stop(w);
 			break;
+#endif
 
 		case UEV_TIMER_TYPE:
 		case UEV_CRON_TYPE:
 			uev_timer_stop(w);
 			break;
 
+#if UEV_HAVE_EVENT
 		case UEV_EVENT_TYPE:
 			uev_event_stop(w);
 			break;
+#endif
+
+#if UEV_HAVE_CHILD
+		case UEV_CHILD_TYPE:
+			uev_child_stop(w);
+			break;
+#endif
+
+#if UEV_HAVE_FILE
+		case UEV_FILE_TYPE:
+			uev_file_stop(w);
+			break;
+#endif
+		default:
+			break;
 		}
 	}
+#if UEV_HAVE_FSWATCH
+	_uev_fswatch_exit(ctx);
+#endif
+#if UEV_HAVE_EVENT
+	_uev_event_exit(ctx);
+#endif
+#if UEV_HAVE_CO
+	_uev_co_exit(ctx);
+#endif
+	_uev_invoke_exit(ctx);
 
 	ctx->watchers = NULL;
+	free(ctx->fds);
+	ctx->fds  = NULL;
+	ctx->fdsz = 0;
+	free(ctx->heap);
+	ctx->heap    = NULL;
+	ctx->heapsz  = 0;
+	ctx->heapcnt = 0;
+	memset(ctx->ready, 0, sizeof(ctx->ready));
+	memset(&ctx->again, 0, sizeof(ctx->again));
 	ctx->running = 0;
+	if (ctx->hifd > -1)
+		close(ctx->hifd);
+	ctx->hifd = -1;
 	if (ctx->fd > -1)
 		close(ctx->fd);
 	ctx->fd = -1;
@@ -282,23 +1350,10 @@ int uev_exit(uev_ctx_t *ctx)
 	return 0;
 }
 
-/**
- * Start the event loop
- * @param ctx    A valid libuEv context
- * @param flags  A mask of ::UEV_ONCE and ::UEV_NONBLOCK, or zero
- *
- * With @p flags set to ::UEV_ONCE the event loop returns after the first
- * event has been served, useful for instance to set a timeout on a file
- * descriptor.  If @p flags also has the ::UEV_NONBLOCK flag set the event
- * loop will return immediately if no event is pending, useful when run
- * inside another event loop.
- *
- * @return POSIX OK(0) upon successful termination of the event loop, or
- * non-zero on error.
- */
-int uev_run(uev_ctx_t *ctx, int flags)
+/* Event loop, with optional deadline in CLOCK_MONOTONIC nanoseconds */
+static int _run(uev_ctx_t *ctx, int flags, uint64_t deadline)
 {
-	int timeout = -1;
+	int64_t timeout = -1;
 	uev_t *w;
 
         if (!ctx || ctx->fd < 0) {
@@ -311,44 +1366,61 @@ int uev_run(uev_ctx_t *ctx, int flags)
 
 	/* Start the event loop */
 	ctx->running = 1;
+	uev_now_update(ctx);
+	_own(ctx, 1);
+
+	/* Wakeup for, and any already queued, commands from other threads */
+	if (_uev_invoke_init(ctx)) {
+		_own(ctx, 0);
+		return -1;
+	}
 
 	/* Start all dormant timers */
 	_UEV_FOREACH(w, ctx->watchers) {
+#if UEV_HAVE_CRON
 		if (UEV_CRON_TYPE == w->type)
 			uev_cron_set(w, w->u.c.when, w->u.c.interval);
-		if (UEV_TIMER_TYPE == w->type)
-			uev_timer_set(w, w->u.t.timeout, w->u.t.period);
+#endif
+		if (UEV_TIMER_TYPE == w->type && w->u.t.timeout && !w->u.t.deadline)
+			uev_hrtimer_set(w, w->u.t.timeout, w->u.t.period, w->u.t.flags);
 	}
 
 	while (ctx->running && ctx->watchers) {
 		struct epoll_event ee[UEV_MAX_EVENTS];
 		int maxevents = ctx->maxevents;
-		int i, nfds, rerun = 0;
+		int64_t tmo;
+		int i, nfds;
+		uint64_t start;
+		int num = 0;
 
 		if (maxevents > UEV_MAX_EVENTS)
 			maxevents = UEV_MAX_EVENTS;
 
-		/* Handle special case: `application < file.txt` */
-		if (ctx->workaround) {
-			_UEV_FOREACH(w, ctx->watchers) {
-				if (w->active != -1 || !w->cb)
-					continue;
+		/* Time left of slice, see uev_run_until() */
+		if (deadline && !(flags & UEV_NONBLOCK)) {
+			uev_now_update(ctx);
+			if (ctx->now >= deadline)
+				break;
+			timeout = deadline - ctx->now;
+		}
 
-				if (!has_data(w->fd)) {
-					w->active = 0;
-					_UEV_REMOVE(w, ctx->watchers);
-				}
+		/* Wake up for the earliest deadline, e.g., token bucket refill */
+		tmo = timeout;
+		if (ctx->heapcnt && tmo) {
+			uint64_t due = ctx->heap[1]->due;
 
-				rerun++;
-				w->cb(w, w->arg, UEV_READ);
-			}
+			uev_now_update(ctx);
+			if (due <= ctx->now)
+				tmo = 0;
+			else if (tmo < 0 || due - ctx->now < (uint64_t)tmo)
+				tmo = due - ctx->now;
 		}
 
-		if (rerun)
-			continue;
-		ctx->workaround = 0;
+		if (ctx->lag.on)
+			ctx->lag.sleep = _monotonic();
 
-		while ((nfds = epoll_wait(ctx->fd, ee, maxevents, timeout)) < 0) {
+		/* Only check for new events if watchers are carried over */
+		while ((nfds = _poll(ctx, ee, maxevents, _requeue(ctx) ? 0 : tmo)) < 0) {
 			if (!ctx->running)
 				break;
 
@@ -356,28 +1428,64 @@ int uev_run(uev_ctx_t *ctx, int flags)
 				continue; /* Signalled, try again */
 
 			/* Unrecoverable error, cleanup and exit with error. */
+			_own(ctx, 0);
 			uev_exit(ctx);
 
 			return -2;
 		}
 
-		for (i = 0; ctx->running && i < nfds; i++) {
+		/* Sort events by watcher priority before dispatch */
+		for (i = 0; i < nfds; i++) {
+			if (ee[i].data.fd == ctx->hifd) {
+				_poll_hi(ctx, maxevents);
+				continue;
+			}
+
+			_queue_fd(ctx, &ee[i]);
+		}
+
+		/* Sample time once per wakeup, for uev_now() and timers */
+		uev_now_update(ctx);
+		start = ctx->now;
+		if (ctx->lag.on)
+			_load(ctx);
+		if (ctx->heapcnt)
+			_expire(ctx);
+		if (ctx->busy_us && nfds > 0)
+			_arrival(ctx);
+
+		while (ctx->running && (w = _unqueue(ctx))) {
+#if UEV_HAVE_SIGNAL
 			struct signalfd_siginfo fdsi;
-			ssize_t sz = sizeof(fdsi);
+#endif
 			uint32_t events;
 			uint64_t exp;
 
-			w = (uev_t *)ee[i].data.ptr;
-			events = ee[i].events;
+			events = w->revents;
+			w->revents = 0;
 
 			switch (w->type) {
 			case UEV_IO_TYPE:
+				/* Any event restarts the idle timeout, lazily */
+				w->last = ctx->now;
 				if (events & (EPOLLHUP | EPOLLERR))
 					uev_io_stop(w);
+#if UEV_HAVE_FILE
+				else if (w->active == _UEV_QUEUED) {
+					/* Regular file, last callback at EOF */
+					if (_uev_file_eof(w))
+						uev_io_stop(w);
+					else
+						_uev_watcher_rearm(w);
+				}
+#endif
 				break;
 
+#if UEV_HAVE_SIGNAL
 			case UEV_SIGNAL_TYPE:
-				if (read(w->fd, &fdsi, sz) != sz) {
+				if (read(w->fd, &fdsi, sizeof(fdsi)) != sizeof(fdsi)) {
+					if (errno == EAGAIN)
+						uev_stat_spurious(w);
 					if (uev_signal_start(w)) {
 						uev_signal_stop(w);
 						events = UEV_ERROR;
@@ -386,19 +1494,30 @@ int uev_run(uev_ctx_t *ctx, int flags)
 				} else
 					w->siginfo = fdsi;
 				break;
+#endif
 
 			case UEV_TIMER_TYPE:
 				if (read(w->fd, &exp, sizeof(exp)) != sizeof(exp)) {
+					if (errno == EAGAIN)
+						uev_stat_spurious(w);
 					uev_timer_stop(w);
 					events = UEV_ERROR;
+					exp = 1;
 				}
 
+				/* Missed expirations, and next deadline */
+				if (ctx->lag.on && events != UEV_ERROR)
+					_lag(ctx, _monotonic(), w->u.t.deadline + (exp - 1) * w->u.t.period);
+				w->overrun = exp - 1;
+				w->u.t.deadline += exp * w->u.t.period;
+
 				if (!w->u.t.period)
 					w->u.t.timeout = 0;
 				if (!w->u.t.timeout)
 					uev_timer_stop(w);
 				break;
 
+#if UEV_HAVE_CRON
 			case UEV_CRON_TYPE:
 				if (read(w->fd, &exp, sizeof(exp)) != sizeof(exp)) {
 					events = UEV_HUP;
@@ -415,28 +1534,136 @@ int uev_run(uev_ctx_t *ctx, int flags)
 				if (!w->u.c.when)
 					uev_timer_stop(w);
 				break;
+#endif
 
+#if UEV_HAVE_EVENT
 			case UEV_EVENT_TYPE:
-				if (read(w->fd, &exp, sizeof(exp)) != sizeof(exp))
+				/* Posted from this thread, nothing to read */
+				if (w->posted) {
+					w->posted = 0;
+					if (!events) {
+						events = UEV_READ;
+						break;
+					}
+				}
+				if (read(w->fd, &exp, sizeof(exp)) != sizeof(exp)) {
+					if (errno == EAGAIN)
+						uev_stat_spurious(w);
 					events = UEV_HUP;
+				}
+				break;
+#endif
+
+#if UEV_HAVE_CHILD
+			case UEV_CHILD_TYPE:
+				switch (_uev_child_reap(w)) {
+				case 0:
+					break;
+				case 1:
+					uev_stat_spurious(w);
+					continue;
+				default:
+					events = UEV_ERROR;
+					break;
+				}
+				uev_child_stop(w);
+				break;
+#endif
+
+#if UEV_HAVE_FILE
+			case UEV_FILE_TYPE:
+				events = _uev_file_read(w);
+				break;
+#endif
+			default:
 				break;
 			}
 
+			if (ctx->profile) {
+				w->prof.count++;
+				w->prof.last = ctx->now;
+
+				/* Already stopped, may be freed in callback */
+				if (_uev_watcher_active(w)) {
+					ctx->prof_w   = w;
+					ctx->prof_cpu = _cputime();
+				}
+			}
+
 			/*
 			 * NOTE: Must be last action for watcher, the
 			 *       callback may delete itself.
 			 */
 			if (w->cb)
 				w->cb(w, w->arg, events & UEV_EVENT_MASK);
+			if (ctx->prof_w)
+				_charge(ctx);
+
+			/* Remaining watchers are carried over to next iteration */
+			if (ctx->budget && ++num >= ctx->budget)
+				break;
+			/* Own clock, callbacks in an iteration see the same uev_now() */
+			if (ctx->budget_us &&
+			    _monotonic() - start >= ctx->budget_us * 1000ULL)
+				break;
 		}
 
 		if (flags & UEV_ONCE)
 			break;
 	}
+	_own(ctx, 0);
 
 	return 0;
 }
 
+/**
+ * Start the event loop
+ * @param ctx    A valid libuEv context
+ * @param flags  A mask of ::UEV_ONCE and ::UEV_NONBLOCK, or zero
+ *
+ * With @p flags set to ::UEV_ONCE the event loop returns after the first
+ * event has been served, useful for instance to set a timeout on a file
+ * descriptor.  If @p flags also has the ::UEV_NONBLOCK flag set the event
+ * loop will return immediately if no event is pending, useful when run
+ * inside another event loop.
+ *
+ * @return POSIX OK(0) upon successful termination of the event loop, or
+ * non-zero on error.
+ */
+int uev_run(uev_ctx_t *ctx, int flags)
+{
+	return _run(ctx, flags, 0);
+}
+
+/**
+ * Run the event loop until a deadline
+ * @param ctx       A valid libuEv context
+ * @param deadline  Absolute CLOCK_MONOTONIC time in nanoseconds, see uev_now()
+ * @param flags     Zero, or ::UEV_ONCE
+ *
+ * Same as uev_run() but returns when @p deadline has passed, or earlier
+ * with ::UEV_ONCE, e.g., to give the event loop the time to spare in
+ * each frame, or tick, of an application's main loop:
+ *
+ *     uev_run_until(&ctx, uev_now(&ctx) + slice, 0);
+ *
+ * An absolute deadline does not drift when called repeatedly.  The
+ * timeout has nanosecond resolution on Linux 5.11, or later, using
+ * epoll_pwait2(), otherwise it is rounded up to milliseconds.
+ *
+ * @return POSIX OK(0) when the deadline has passed, or the event loop
+ * was terminated, non-zero on error.
+ */
+int uev_run_until(uev_ctx_t *ctx, uint64_t deadline, int flags)
+{
+	if (!deadline || (flags & UEV_NONBLOCK)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return _run(ctx, flags, deadline);
+}
+
 /**
  * Local Variables:
  *  indent-tabs-mode: t
@@ -38,6 +38,10 @@
 
 #include "private.h"
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define UEV_MAX_EVENTS  10		/**< Max. number of simulateneous events */
 
 /* I/O events, signal and timer revents are always UEV_READ */
@@ -50,21 +54,49 @@
 #define UEV_RDHUP       EPOLLRDHUP	/**< peer shutdown    */
 #define UEV_EDGE        EPOLLET		/**< edge triggered   */
 #define UEV_ONESHOT     EPOLLONESHOT	/**< one-shot event   */
+#define UEV_TIMEOUT     (1 << 20)	/**< idle timeout, see uev_io_timeout_set() */
 
 /* Run flags */
 #define UEV_ONCE        1		/**< run loop once    */
 #define UEV_NONBLOCK    2		/**< exit if no event */
 
+/* Timer flags */
+#define UEV_TIMER_ABSTIME 1		/**< absolute deadline */
+
+/* Watcher priorities */
+#define UEV_PRIO_MIN    -2		/**< lowest priority  */
+#define UEV_PRIO_MAX    2		/**< highest priority, polled first */
+
 /** Check if I/O watcher is active or stopped */
 #define uev_io_active(w)     _uev_watcher_active(w)
-/** Check if signal watcher is active or stopped */
-#define uev_signal_active(w) _uev_watcher_active(w)
 /** Check if timer is active or stopped */
 #define uev_timer_active(w)  _uev_watcher_active(w)
+/** Check if high resolution timer is active or stopped */
+#define uev_hrtimer_active(w) _uev_watcher_active(w)
+#if UEV_HAVE_SIGNAL
+/** Check if signal watcher is active or stopped */
+#define uev_signal_active(w) _uev_watcher_active(w)
+#endif
+#if UEV_HAVE_CRON
 /** Check if cron timer watcher is active or stopped */
 #define uev_cron_active(w)   _uev_watcher_active(w)
+#endif
+#if UEV_HAVE_EVENT
 /** Check if event watcher is active or stopped */
 #define uev_event_active(w)  _uev_watcher_active(w)
+#endif
+#if UEV_HAVE_CHILD
+/** Check if child process watcher is active or stopped */
+#define uev_child_active(w)  _uev_watcher_active(w)
+#endif
+#if UEV_HAVE_FSWATCH
+/** Check if file system watcher is active or stopped */
+#define uev_fswatch_active(w) _uev_watcher_active(w)
+#endif
+#if UEV_HAVE_FILE
+/** Check if file reader watcher is active or stopped */
+#define uev_file_active(w)   _uev_watcher_active(w)
+#endif
 
 /** Event loop context, need one per process and thread */
 typedef struct uev_ctx uev_ctx_t;
@@ -81,6 +113,11 @@ typedef struct uev {
 
 	/* Extra data for certain watcher types */
 	struct signalfd_siginfo siginfo; /**< received signal  */
+	uint64_t        overrun;	 /**< missed timer expirations */
+	uint32_t        mask;		 /**< inotify(7) event mask */
+	const char     *name;		 /**< inotify(7) file name, or NULL */
+	const char     *data;		 /**< file reader chunk */
+	size_t          len;		 /**< file reader chunk length */
 } uev_t;
 
 /**
@@ -96,6 +133,45 @@ typedef struct uev {
  */
 typedef void (uev_cb_t)(uev_t *w, void *arg, int events);
 
+/** Watcher profiling counters, see uev_stat_next() */
+struct uev_stat {
+	const char     *type;		/**< "io", "timer", "signal", ... */
+	int             fd;		/**< active descriptor */
+	int             events;		/**< requested events */
+	uint64_t        count;		/**< number of callbacks */
+	uint64_t        cpu;		/**< thread CPU time in callbacks, nsec */
+	uint64_t        last;		/**< uev_now() at last callback */
+	uint64_t        spurious;	/**< wakeups with nothing to do */
+};
+
+#if UEV_INLINE
+/* Private to libuEv, do not use directly! */
+static inline int _uev_watcher_active(uev_t *w)
+{
+	return w && w->active > 0;
+}
+#endif
+
+/** Loop lag and utilisation, see uev_lag_get() */
+struct uev_lag {
+	uint64_t        lag;		/**< timer lag, average, nsec */
+	uint64_t        peak;		/**< max timer lag since last read, nsec */
+	int             util;		/**< loop utilisation, average, percent */
+	int             overload;	/**< threshold crossed, see uev_lag_set() */
+};
+
+/** Overload hook, see uev_lag_set() */
+typedef void (uev_lag_cb_t)(uev_ctx_t *ctx, void *arg, int overload);
+
+/** Function run by the event loop, see uev_invoke() */
+typedef void (uev_invoke_fn_t)(uev_ctx_t *ctx, void *arg);
+
+/** Coroutine, see uev_co_spawn() */
+typedef struct uev_co uev_co_t;
+
+/** Coroutine function, the coroutine is done when it returns */
+typedef void (uev_co_fn_t)(uev_co_t *co, void *arg);
+
 /* Public interface */
 
 /** Create an event loop context */
@@ -103,30 +179,90 @@ int uev_init           (uev_ctx_t *ctx);
 int uev_init1          (uev_ctx_t *ctx, int maxevents);
 int uev_exit           (uev_ctx_t *ctx);
 int uev_run            (uev_ctx_t *ctx, int flags);
+int uev_run_until      (uev_ctx_t *ctx, uint64_t deadline, int flags);
+int uev_invoke         (uev_ctx_t *ctx, uev_invoke_fn_t *fn, void *arg);
+
+int uev_prio_set       (uev_t *w, int prio);
+int uev_budget_set     (uev_ctx_t *ctx, int callbacks, int usec);
+int uev_busypoll_set   (uev_ctx_t *ctx, int usec);
+
+int uev_profile_set    (uev_ctx_t *ctx, int enable);
+int uev_stat_spurious  (uev_t *w);
+uev_t *uev_stat_next   (uev_ctx_t *ctx, uev_t *w, struct uev_stat *st);
+
+int uev_lag_set        (uev_ctx_t *ctx, int lag_us, int util, uev_lag_cb_t *cb, void *arg);
+int uev_lag_get        (uev_ctx_t *ctx, struct uev_lag *lag);
+
+uint64_t uev_now       (uev_ctx_t *ctx);
+uint64_t uev_now_real  (uev_ctx_t *ctx);
+int uev_now_update     (uev_ctx_t *ctx);
 
 int uev_io_init        (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int fd, int events);
 int uev_io_set         (uev_t *w, int fd, int events);
 int uev_io_start       (uev_t *w);
 int uev_io_stop        (uev_t *w);
+int uev_io_requeue     (uev_t *w);
+int uev_io_rate_set    (uev_t *w, uint64_t rate, uint64_t burst);
+int uev_io_rate_consume(uev_t *w, size_t num);
+uint64_t uev_io_rate_avail(uev_t *w);
+int uev_io_timeout_set (uev_t *w, int msec);
 
 int uev_timer_init     (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int timeout, int period);
 int uev_timer_set      (uev_t *w, int timeout, int period);
 int uev_timer_start    (uev_t *w);
 int uev_timer_stop     (uev_t *w);
 
+int uev_hrtimer_init   (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, uint64_t timeout, uint64_t period, int flags);
+int uev_hrtimer_set    (uev_t *w, uint64_t timeout, uint64_t period, int flags);
+
+#if UEV_HAVE_CRON
 int uev_cron_init      (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, time_t when, time_t interval);
 int uev_cron_set       (uev_t *w, time_t when, time_t interval);
 int uev_cron_start     (uev_t *w);
 int uev_cron_stop      (uev_t *w);
+#endif
 
+#if UEV_HAVE_SIGNAL
 int uev_signal_init    (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int signo);
 int uev_signal_set     (uev_t *w, int signo);
 int uev_signal_start   (uev_t *w);
 int uev_signal_stop    (uev_t *w);
+#endif
 
+#if UEV_HAVE_EVENT
 int uev_event_init     (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg);
 int uev_event_post     (uev_t *w);
+int uev_event_shared_set(uev_ctx_t *ctx, int enable);
 int uev_event_stop     (uev_t *w);
+#endif
+
+#if UEV_HAVE_CHILD
+int uev_child_init     (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, pid_t pid);
+int uev_child_stop     (uev_t *w);
+#endif
+
+#if UEV_HAVE_FSWATCH
+int uev_fswatch_init   (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, const char *path, uint32_t mask);
+int uev_fswatch_stop   (uev_t *w);
+#endif
+
+#if UEV_HAVE_FILE
+int uev_file_init      (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, int fd);
+int uev_file_open      (uev_ctx_t *ctx, uev_t *w, uev_cb_t *cb, void *arg, const char *path);
+int uev_file_stop      (uev_t *w);
+#endif
+
+#if UEV_HAVE_CO
+int     uev_co_spawn     (uev_ctx_t *ctx, uev_co_fn_t *fn, void *arg);
+ssize_t uev_co_read      (uev_co_t *co, int fd, void *buf, size_t len);
+ssize_t uev_co_write     (uev_co_t *co, int fd, const void *buf, size_t len);
+int     uev_co_sleep     (uev_co_t *co, int msec);
+int     uev_co_wait_event(uev_co_t *co, uev_t *w);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* LIBUEV_UEV_H_ */
 
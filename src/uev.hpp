@@ -0,0 +1,373 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef LIBUEV_UEV_HPP_
+#define LIBUEV_UEV_HPP_
+
+/**
+ * Header-only C++ wrapper, requires C++17
+ * @file uev.hpp
+ *
+ * RAII types for the event context and the most common watchers.  The
+ * callback is bound at compile time, as a template argument, to either
+ * a member function or a free function.  With C++20 a stateless lambda
+ * can also be used.  The C callback is a template trampoline, so there
+ * is no allocation, no type erasure, and each watcher is exactly the
+ * size of a uev_t:
+ *
+ *     struct Conn {
+ *         libuev::Io io;
+ *         void on_read(libuev::Io &w, int events);
+ *     };
+ *
+ *     conn->io.start<&Conn::on_read>(loop, conn, sd, UEV_READ);
+ *     tmo.start<[](libuev::Timer &w, int) { w.loop().exit(); }>(loop, 1000);
+ *
+ * The callback gets the watcher itself and the @p events mask.  Start
+ * functions return the same as the C API, POSIX OK(0) or non-zero with
+ * @p errno set on error.  Watchers are stopped when destroyed, and are
+ * neither copyable nor movable, since libuEv references them.
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <system_error>
+#include <type_traits>
+
+#include "uev.h"
+
+namespace libuev {
+
+namespace detail {
+
+/*
+ * Recycling allocator for short-lived objects tied to a Loop, e.g.,
+ * coroutine frames, see uev_coro.hpp.  Blocks are kept on free lists
+ * per 64 byte size class, larger ones go straight to the heap.  Each
+ * block has a header with its pool, so blocks may outlive the Loop,
+ * the pool is deleted with its last block.
+ */
+class Pool {
+public:
+	static void *alloc(Pool *pool, size_t size)
+	{
+		size_t cls = (size + sizeof(Header) - 1) / GRAIN;
+		Header *h;
+
+		if (!pool || cls >= CLASSES) {
+			h = static_cast<Header *>(::operator new(size + sizeof(Header)));
+			h->pool = nullptr;
+			return h + 1;
+		}
+
+		h = pool->free_[cls];
+		if (h)
+			pool->free_[cls] = h->next;
+		else
+			h = static_cast<Header *>(::operator new((cls + 1) * GRAIN));
+		h->pool = pool;
+		h->cls  = cls;
+		pool->live_++;
+
+		return h + 1;
+	}
+
+	static void release(void *ptr) noexcept
+	{
+		Header *h = static_cast<Header *>(ptr) - 1;
+		Pool *pool = h->pool;
+		size_t cls;
+
+		if (!pool) {
+			::operator delete(h);
+			return;
+		}
+
+		pool->live_--;
+		if (pool->dead_) {
+			::operator delete(h);
+			if (!pool->live_)
+				delete pool;
+			return;
+		}
+
+		/* Shares storage with next */
+		cls = h->cls;
+		h->next = pool->free_[cls];
+		pool->free_[cls] = h;
+	}
+
+	/* Loop is gone, free cached blocks, and pool when the last is released */
+	void retire() noexcept
+	{
+		for (auto &head : free_) {
+			while (head) {
+				Header *h = head;
+
+				head = h->next;
+				::operator delete(h);
+			}
+		}
+
+		dead_ = true;
+		if (!live_)
+			delete this;
+	}
+
+private:
+	static constexpr size_t GRAIN   = 64;
+	static constexpr size_t CLASSES = 128;	/* Up to 8 kiB */
+
+	struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header {
+		Pool   *pool;
+		union {
+			size_t  cls;
+			Header *next;	/* On free list */
+		};
+	};
+
+	Header *free_[CLASSES] = {};
+	size_t  live_ = 0;
+	bool    dead_ = false;
+};
+
+} /* namespace detail */
+
+/** Event loop context, see uev_init() */
+class Loop {
+public:
+	/** Throws std::system_error if uev_init1() fails */
+	explicit Loop(int maxevents = UEV_MAX_EVENTS)
+	{
+		if (uev_init1(&ctx_, maxevents))
+			throw std::system_error(errno, std::generic_category(), "uev_init1");
+	}
+	~Loop()
+	{
+		uev_exit(&ctx_);
+		if (pool_)
+			pool_->retire();
+	}
+
+	Loop(const Loop &) = delete;
+	Loop &operator=(const Loop &) = delete;
+
+	int run(int flags = 0) noexcept { return uev_run(&ctx_, flags); }
+	int exit() noexcept             { return uev_exit(&ctx_); }
+	uint64_t now() noexcept         { return uev_now(&ctx_); }
+
+	uev_ctx_t *native() noexcept    { return &ctx_; }
+
+	/** Recycling allocator, e.g., for coroutine frames */
+	detail::Pool *pool()
+	{
+		if (!pool_)
+			pool_ = new detail::Pool;
+		return pool_;
+	}
+
+	/** The Loop a watcher's context belongs to */
+	static Loop &from(uev_ctx_t *ctx) noexcept
+	{
+		return *reinterpret_cast<Loop *>(ctx);
+	}
+
+private:
+	uev_ctx_t     ctx_;		/* Must be first, see from() */
+	detail::Pool *pool_ = nullptr;
+};
+
+namespace detail {
+
+template <class M>
+struct member_of;
+
+template <class T, class R, class W>
+struct member_of<R (T::*)(W &, int)> {
+	using type = T;
+};
+
+/*
+ * Trampoline from uev_cb_t to the callback bound at compile time.  The
+ * watcher types are standard layout with the uev_t as their only data
+ * member, so the uev_t pointer is also a pointer to the watcher.
+ */
+template <class W, auto Fn>
+void trampoline(uev_t *w, void *arg, int events)
+{
+	W &self = *reinterpret_cast<W *>(w);
+
+	if constexpr (std::is_member_function_pointer_v<decltype(Fn)>) {
+		using T = typename member_of<decltype(Fn)>::type;
+
+		(static_cast<T *>(arg)->*Fn)(self, events);
+	} else {
+		Fn(self, events);
+	}
+	(void)arg;
+}
+
+} /* namespace detail */
+
+/** Common base for all watcher types, use the derived types */
+template <class W>
+class Watcher {
+public:
+	Watcher() noexcept
+	{
+		std::memset(&w_, 0, sizeof(w_));
+		w_.fd = -1;
+	}
+
+	Watcher(const Watcher &) = delete;
+	Watcher &operator=(const Watcher &) = delete;
+
+	bool active() noexcept   { return _uev_watcher_active(&w_); }
+	int  fd() const noexcept { return w_.fd; }
+	int  prio(int prio) noexcept { return uev_prio_set(&w_, prio); }
+	Loop &loop() noexcept    { return Loop::from(w_.ctx); }
+	uev_t *native() noexcept { return &w_; }
+
+protected:
+	template <auto Fn>
+	static constexpr uev_cb_t *cb() noexcept
+	{
+		return &detail::trampoline<W, Fn>;
+	}
+
+	uev_t w_;
+};
+
+/** I/O watcher, see uev_io_init() */
+class Io : public Watcher<Io> {
+public:
+	~Io() { stop(); }
+
+	template <auto Fn>
+	int start(Loop &loop, int fd, int events) noexcept
+	{
+		return uev_io_init(loop.native(), &w_, cb<Fn>(), nullptr, fd, events);
+	}
+
+	template <auto Fn, class T>
+	int start(Loop &loop, T *obj, int fd, int events) noexcept
+	{
+		return uev_io_init(loop.native(), &w_, cb<Fn>(), obj, fd, events);
+	}
+
+	int set(int fd, int events) noexcept { return uev_io_set(&w_, fd, events); }
+	int start() noexcept                 { return uev_io_start(&w_); }
+	int stop() noexcept                  { return uev_io_stop(&w_); }
+	int requeue() noexcept               { return uev_io_requeue(&w_); }
+};
+
+/** Timer watcher, in milliseconds, see uev_timer_init() */
+class Timer : public Watcher<Timer> {
+public:
+	~Timer() { stop(); }
+
+	template <auto Fn>
+	int start(Loop &loop, int timeout, int period = 0) noexcept
+	{
+		return uev_timer_init(loop.native(), &w_, cb<Fn>(), nullptr, timeout, period);
+	}
+
+	template <auto Fn, class T>
+	int start(Loop &loop, T *obj, int timeout, int period = 0) noexcept
+	{
+		return uev_timer_init(loop.native(), &w_, cb<Fn>(), obj, timeout, period);
+	}
+
+	int set(int timeout, int period = 0) noexcept { return uev_timer_set(&w_, timeout, period); }
+	int start() noexcept                          { return uev_timer_start(&w_); }
+	int stop() noexcept                           { return uev_timer_stop(&w_); }
+	uint64_t overrun() const noexcept             { return w_.overrun; }
+};
+
+#if UEV_HAVE_SIGNAL
+/** Signal watcher, see uev_signal_init() */
+class Signal : public Watcher<Signal> {
+public:
+	~Signal() { stop(); }
+
+	template <auto Fn>
+	int start(Loop &loop, int signo) noexcept
+	{
+		return uev_signal_init(loop.native(), &w_, cb<Fn>(), nullptr, signo);
+	}
+
+	template <auto Fn, class T>
+	int start(Loop &loop, T *obj, int signo) noexcept
+	{
+		return uev_signal_init(loop.native(), &w_, cb<Fn>(), obj, signo);
+	}
+
+	int start() noexcept { return uev_signal_start(&w_); }
+	int stop() noexcept  { return uev_signal_stop(&w_); }
+	const struct signalfd_siginfo &siginfo() const noexcept { return w_.siginfo; }
+};
+
+static_assert(sizeof(Signal) == sizeof(uev_t) && std::is_standard_layout_v<Signal>);
+#endif
+
+#if UEV_HAVE_EVENT
+/** Event watcher, posted from any thread, see uev_event_init() */
+class Event : public Watcher<Event> {
+public:
+	~Event() { stop(); }
+
+	template <auto Fn>
+	int start(Loop &loop) noexcept
+	{
+		return uev_event_init(loop.native(), &w_, cb<Fn>(), nullptr);
+	}
+
+	template <auto Fn, class T>
+	int start(Loop &loop, T *obj) noexcept
+	{
+		return uev_event_init(loop.native(), &w_, cb<Fn>(), obj);
+	}
+
+	int post() noexcept { return uev_event_post(&w_); }
+	int stop() noexcept { return uev_event_stop(&w_); }
+};
+
+static_assert(sizeof(Event) == sizeof(uev_t) && std::is_standard_layout_v<Event>);
+#endif
+
+static_assert(sizeof(Io) == sizeof(uev_t) && std::is_standard_layout_v<Io>);
+static_assert(sizeof(Timer) == sizeof(uev_t) && std::is_standard_layout_v<Timer>);
+static_assert(std::is_standard_layout_v<Loop>);
+
+} /* namespace libuev */
+
+#endif /* LIBUEV_UEV_HPP_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
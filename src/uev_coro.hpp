@@ -0,0 +1,248 @@
+/* libuEv - Micro event loop library
+ *
+ * Copyright (c) 2013-2024  Joachim Wiberg <troglobit()gmail!com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef LIBUEV_UEV_CORO_HPP_
+#define LIBUEV_UEV_CORO_HPP_
+
+/**
+ * C++20 coroutine awaitables for libuEv watchers
+ * @file uev_coro.hpp
+ *
+ * A libuev::Task is a detached coroutine, it runs at once until its
+ * first `co_await` and is destroyed when it returns.  The awaitables
+ * start, or reuse, a watcher from uev.hpp and the event loop resumes
+ * the coroutine from the watcher's callback, no extra threads:
+ *
+ *     libuev::Task echo(libuev::Loop &loop, int sd)
+ *     {
+ *         libuev::Io rd;
+ *         char buf[512];
+ *
+ *         while (co_await libuev::readable(loop, rd, sd) == UEV_READ) {
+ *             ...
+ *         }
+ *     }
+ *
+ * The watcher is owned by the coroutine, and kept started between
+ * awaits, so waiting on the same descriptor again costs no system
+ * calls.  Use one watcher per direction, e.g., `rd` and `wr` for the
+ * same socket.  Events arriving while the coroutine is not waiting
+ * stop an I/O watcher, disarm a timer, are counted in uev::overrun for
+ * signal and event watchers, and complete the next wait at once.
+ *
+ * A sleep() timer also stays open between awaits, each sleep only
+ * rearms it, one timerfd_settime(2), instead of creating a new timer.
+ *
+ * Frames of coroutines with a libuev::Loop reference as their first
+ * argument, or second for member functions, are allocated from that
+ * Loop's recycling pool, so handling requests does not allocate from
+ * the heap in steady state.
+ */
+
+#include <coroutine>
+#include <exception>
+
+#include "uev.hpp"
+
+namespace libuev {
+
+/** Detached coroutine, frame from the Loop's pool when possible */
+struct Task {
+	struct promise_type {
+		Task get_return_object() noexcept          { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept   { return {}; }
+		void return_void() noexcept                { }
+		void unhandled_exception() noexcept        { std::terminate(); }
+
+		template <class... Args>
+		static void *operator new(size_t size, Loop &loop, Args &...)
+		{
+			return detail::Pool::alloc(loop.pool(), size);
+		}
+
+		template <class T, class... Args>
+		static void *operator new(size_t size, T &, Loop &loop, Args &...)
+		{
+			return detail::Pool::alloc(loop.pool(), size);
+		}
+
+		static void *operator new(size_t size)
+		{
+			return detail::Pool::alloc(nullptr, size);
+		}
+
+		static void operator delete(void *ptr) noexcept
+		{
+			detail::Pool::release(ptr);
+		}
+	};
+};
+
+/** Returned by the awaitables, `co_await` gives the event mask */
+class Wait {
+public:
+	explicit Wait(uev_t *w, int events = 0) noexcept : w_(w), events_(events) { }
+
+	bool await_ready() const noexcept { return events_ != 0; }
+
+	void await_suspend(std::coroutine_handle<> h) noexcept
+	{
+		h_ = h;
+		w_->arg = this;
+	}
+
+	int await_resume() const noexcept { return events_; }
+
+	/* Callback for all awaited watchers, private to libuEv */
+	static void wake(uev_t *w, void *arg, int events)
+	{
+		Wait *wait = static_cast<Wait *>(arg);
+
+		if (!wait) {
+			/* Not waiting, keep for next wait, or stop level triggered I/O */
+			if (w->type == UEV_IO_TYPE)
+				uev_io_stop(w);
+			else if (w->type == UEV_TIMER_TYPE)
+				uev_timer_set(w, 0, 0);
+			else
+				w->overrun++;
+			return;
+		}
+
+		/* Coroutine may return, and destroy w, must be last */
+		w->arg = nullptr;
+		wait->events_ = events ? events : (int)UEV_READ;
+		wait->h_.resume();
+	}
+
+private:
+	uev_t                  *w_;
+	int                     events_;
+	std::coroutine_handle<> h_;
+};
+
+namespace detail {
+
+inline Wait io(Loop &loop, Io &io, int fd, int events)
+{
+	uev_t *w = io.native();
+
+	if (!io.active() || io.fd() != fd || w->events != events) {
+		io.stop();
+		if (uev_io_init(loop.native(), w, Wait::wake, nullptr, fd, events))
+			return Wait(w, UEV_ERROR);
+	}
+
+	return Wait(w);
+}
+
+/* Signal and event watchers count events that arrived while not waiting */
+inline Wait pending(uev_t *w)
+{
+	if (w->overrun) {
+		w->overrun--;
+		return Wait(w, UEV_READ);
+	}
+
+	return Wait(w);
+}
+
+} /* namespace detail */
+
+/** Wait until @p fd is readable, using watcher @p io */
+inline Wait readable(Loop &loop, Io &io, int fd)
+{
+	return detail::io(loop, io, fd, UEV_READ);
+}
+
+/** Wait until @p fd is writable, using watcher @p io */
+inline Wait writable(Loop &loop, Io &io, int fd)
+{
+	return detail::io(loop, io, fd, UEV_WRITE);
+}
+
+/**
+ * Wait @p msec milliseconds, using watcher @p timer.  Periodic, so the
+ * event loop does not close it after expiry, disarmed by Wait::wake()
+ * if it expires again before the next sleep.
+ */
+inline Wait sleep(Loop &loop, Timer &timer, int msec)
+{
+	uev_t *w = timer.native();
+
+	if (timer.active() && w->cb == Wait::wake) {
+		if (uev_timer_set(w, msec, msec))
+			return Wait(w, UEV_ERROR);
+	} else {
+		timer.stop();
+		if (uev_timer_init(loop.native(), w, Wait::wake, nullptr, msec, msec))
+			return Wait(w, UEV_ERROR);
+	}
+
+	return Wait(w);
+}
+
+#if UEV_HAVE_SIGNAL
+/** Wait for signal @p signo, using watcher @p sig, siginfo in sig.siginfo() */
+inline Wait signal(Loop &loop, Signal &sig, int signo)
+{
+	uev_t *w = sig.native();
+
+	if (!sig.active() || w->signo != signo) {
+		sig.stop();
+		if (uev_signal_init(loop.native(), w, Wait::wake, nullptr, signo))
+			return Wait(w, UEV_ERROR);
+		w->overrun = 0;
+	}
+
+	return detail::pending(w);
+}
+#endif
+
+#if UEV_HAVE_EVENT
+/** Wait for @p ev to be posted, e.g., from another thread */
+inline Wait posted(Loop &loop, Event &ev)
+{
+	uev_t *w = ev.native();
+
+	if (!ev.active()) {
+		if (uev_event_init(loop.native(), w, Wait::wake, nullptr))
+			return Wait(w, UEV_ERROR);
+		w->overrun = 0;
+	}
+
+	return detail::pending(w);
+}
+#endif
+
+} /* namespace libuev */
+
+#endif /* LIBUEV_UEV_CORO_HPP_ */
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
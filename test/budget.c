@@ -0,0 +1,88 @@
+/* Verify dispatch budget and round-robin requeue of I/O watchers */
+#include "check.h"
+#include <fcntl.h>
+
+#define NUM 4
+
+int calls[NUM];
+int total;
+uint64_t seen;
+int slow;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	int i = (int)(long)arg;
+
+	calls[i]++;
+	total++;
+
+	/* Time budget does not move the cached loop time */
+	if (slow) {
+		if (seen)
+			fail_unless(uev_now(w->ctx) == seen);
+		seen = uev_now(w->ctx);
+		usleep(500);
+	}
+
+	/* Watcher 0 pretends to never reach EAGAIN */
+	if (i == 0 && calls[i] < 3)
+		uev_io_requeue(w);
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	uev_t w[NUM];
+	int fds[NUM][2];
+	int i;
+
+	uev_init(&ctx);
+	fail_unless(uev_budget_set(&ctx, 2, 0) == 0);
+	fail_unless(uev_budget_set(&ctx, -1, 0) != 0);
+
+	for (i = 0; i < NUM; i++) {
+		fail_unless(pipe2(fds[i], O_NONBLOCK) == 0);
+		fail_unless(uev_io_init(&ctx, &w[i], cb, (void *)(long)i, fds[i][0], UEV_READ | UEV_EDGE) == 0);
+		fail_unless(write(fds[i][1], "x", 1) == 1);
+	}
+
+	/* Budget of two callbacks, the rest are carried over */
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(total == 2);
+
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(total == 4);
+	for (i = 0; i < NUM; i++)
+		fail_unless(calls[i] == 1);
+
+	/* Edge triggered, only the requeued watcher is called again */
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(calls[0] == 3);
+	fail_unless(total == 6);
+
+	/* Budget of 1 msec, at most two 500 usec callbacks per iteration */
+	fail_unless(uev_budget_set(&ctx, 0, 1000) == 0);
+	for (i = 0; i < NUM; i++)
+		fail_unless(write(fds[i][1], "x", 1) == 1);
+
+	slow = 1;
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(total > 6 && total <= 8);
+	while (total < 10) {
+		seen = 0;
+		uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	}
+	for (i = 0; i < NUM; i++)
+		fail_unless(calls[i] == (i ? 2 : 4));
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,62 @@
+/* Verify pidfd based child process watcher */
+#include "check.h"
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define STATUS 42
+
+pid_t pid;
+int result = -1;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	fail_unless(events != UEV_ERROR);
+	fail_unless(w->siginfo.ssi_pid == (uint32_t)pid);
+	fail_unless(w->siginfo.ssi_code == CLD_EXITED);
+	fail_unless(w->siginfo.ssi_status == STATUS);
+	fail_unless(!uev_child_active(w));
+
+	/* Already reaped by libuEv */
+	fail_unless(waitpid(pid, NULL, WNOHANG) == -1);
+
+	result = 0;
+	uev_exit(w->ctx);
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	uev_t w;
+
+	uev_init(&ctx);
+
+	pid = fork();
+	if (-1 == pid)
+		err(1, "fork");
+	if (pid == 0) {
+		usleep(10000);
+		_exit(STATUS);
+	}
+
+	if (uev_child_init(&ctx, &w, cb, NULL, pid)) {
+		if (errno == ENOSYS) {
+			waitpid(pid, NULL, 0);
+			return 77; /* pidfd_open() not supported, skip */
+		}
+		err(1, "uev_child_init");
+	}
+
+	uev_run(&ctx, 0);
+	fail_unless(result == 0);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
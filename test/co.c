@@ -0,0 +1,104 @@
+/* Verify coroutines: blocking-style read/write, sleep, and event wait */
+#include "check.h"
+#include <errno.h>
+#include <sys/socket.h>
+
+#define LAPS  100
+#define NUM   1000
+
+int sv[2];
+int echoed, pinged, slept, waited, spawned;
+uev_t ev, timer;
+
+static void server(uev_co_t *co, void *arg)
+{
+	char buf[16];
+	ssize_t len;
+
+	while ((len = uev_co_read(co, sv[1], buf, sizeof(buf))) > 0) {
+		fail_unless(uev_co_write(co, sv[1], buf, len) == len);
+		echoed++;
+	}
+	fail_unless(len == 0);
+}
+
+static void client(uev_co_t *co, void *arg)
+{
+	char buf[16];
+	int i;
+
+	for (i = 0; i < LAPS; i++) {
+		fail_unless(uev_co_write(co, sv[0], "ping", 4) == 4);
+		fail_unless(uev_co_read(co, sv[0], buf, sizeof(buf)) == 4);
+		fail_unless(!memcmp(buf, "ping", 4));
+		pinged++;
+	}
+
+	shutdown(sv[0], SHUT_WR);
+}
+
+static void sleeper(uev_co_t *co, void *arg)
+{
+	uint64_t start = uev_now(*(uev_ctx_t **)arg);
+
+	fail_unless(uev_co_sleep(co, 10) == 0);
+	fail_unless(uev_now(*(uev_ctx_t **)arg) - start >= 10000000ULL);
+	slept++;
+
+	/* Posted from timer callback below */
+	fail_unless(uev_co_wait_event(co, &ev) == UEV_READ);
+	uev_event_stop(&ev);
+	waited++;
+}
+
+static void post(uev_t *w, void *arg, int events)
+{
+	uev_event_post(&ev);
+}
+
+static void nop(uev_t *w, void *arg, int events)
+{
+	fail_unless(0);
+}
+
+static void quick(uev_co_t *co, void *arg)
+{
+	spawned++;
+}
+
+int main(void)
+{
+	uev_ctx_t ctx, *ptr = &ctx;
+	int i;
+
+	fail_unless(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+
+	uev_init(&ctx);
+	fail_unless(uev_co_spawn(NULL, server, NULL) == -1 && errno == EINVAL);
+
+	/* Runs to completion at once, stacks are reused from pool */
+	for (i = 0; i < NUM; i++)
+		fail_unless(uev_co_spawn(&ctx, quick, NULL) == 0);
+	fail_unless(spawned == NUM);
+
+	fail_unless(uev_co_spawn(&ctx, server, NULL) == 0);
+	fail_unless(uev_co_spawn(&ctx, client, NULL) == 0);
+
+	uev_event_init(&ctx, &ev, nop, NULL);
+	uev_timer_init(&ctx, &timer, post, NULL, 50, 0);
+	fail_unless(uev_co_spawn(&ctx, sleeper, &ptr) == 0);
+
+	/* Loop exits when all coroutines are done */
+	fail_unless(uev_run(&ctx, 0) == 0);
+	fail_unless(pinged == LAPS && echoed == LAPS);
+	fail_unless(slept == 1 && waited == 1);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,159 @@
+/* Verify C++20 coroutine awaitables, uev_coro.hpp */
+#include "check.h"
+#include "../src/uev_coro.hpp"
+
+#include <new>
+#include <sys/socket.h>
+
+using namespace libuev;
+
+static size_t allocs;
+static int pongs, naps, posts, quick;
+static Event ev;
+
+void *operator new(size_t size)
+{
+	void *ptr = malloc(size);
+
+	if (!ptr)
+		throw std::bad_alloc();
+	allocs++;
+
+	return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+static Task pinger(Loop &loop, int sd)
+{
+	Io rd, wr;
+	char buf[8];
+
+	for (int i = 0; i < 10; i++) {
+		fail_unless(co_await writable(loop, wr, sd) == UEV_WRITE);
+		fail_unless(write(sd, "ping", 4) == 4);
+
+		fail_unless(co_await readable(loop, rd, sd) == UEV_READ);
+		fail_unless(read(sd, buf, sizeof(buf)) == 4);
+		pongs++;
+	}
+
+	/* Hang up, ponger returns, and the loop with it */
+	shutdown(sd, SHUT_WR);
+}
+
+static Task ponger(Loop &loop, int sd)
+{
+	char buf[8];
+	ssize_t len;
+	Io rd;
+
+	while (co_await readable(loop, rd, sd) == UEV_READ) {
+		len = read(sd, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+		fail_unless(write(sd, "pong", 4) == 4);
+	}
+}
+
+static Task sleeper(Loop &loop)
+{
+	uint64_t start = loop.now();
+	Timer tmo;
+	int fd;
+
+	fail_unless(co_await sleep(loop, tmo, 10) == UEV_READ);
+	fail_unless(loop.now() - start >= 10000000ULL);
+	naps++;
+
+	/* Posted before we wait, and after, same timer rearmed */
+	fail_unless(tmo.active());
+	fd = tmo.fd();
+	ev.post();
+	fail_unless(co_await sleep(loop, tmo, 10) == UEV_READ);
+	fail_unless(tmo.fd() == fd);
+	fail_unless(co_await posted(loop, ev) == UEV_READ);
+	posts++;
+
+	fail_unless(co_await posted(loop, ev) == UEV_READ);
+	posts++;
+	ev.stop();
+}
+
+static Task poster(Loop &loop)
+{
+	Timer tmo;
+
+	co_await sleep(loop, tmo, 50);
+	ev.post();
+}
+
+static Task nop(Loop &loop)
+{
+	quick++;
+	co_return;
+}
+
+int main(void)
+{
+	size_t before;
+	int sv[2];
+	Loop loop;
+
+	fail_unless(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+
+	/* Frames are recycled from the Loop's pool */
+	nop(loop);
+	before = allocs;
+	for (int i = 0; i < 100; i++)
+		nop(loop);
+	fail_unless(quick == 101 && allocs == before);
+
+	/* Released blocks go back on the free list of their size class */
+	{
+		detail::Pool *pool = loop.pool();
+		void *blk[3], *again[3];
+
+		for (auto &b : blk)
+			b = detail::Pool::alloc(pool, 200);
+		for (auto &b : blk)
+			detail::Pool::release(b);
+
+		before = allocs;
+		for (auto &b : again)
+			b = detail::Pool::alloc(pool, 200);
+		fail_unless(allocs == before);
+		fail_unless(again[0] == blk[2] && again[1] == blk[1] && again[2] == blk[0]);
+		for (auto &b : again)
+			detail::Pool::release(b);
+	}
+
+	/* Started before the event watcher, must not miss the first post */
+	sleeper(loop);
+	posted(loop, ev);
+	poster(loop);
+
+	pinger(loop, sv[0]);
+	ponger(loop, sv[1]);
+	fail_unless(loop.run() == 0);
+
+	fail_unless(pongs == 10);
+	fail_unless(naps == 1 && posts == 2);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,73 @@
+/* Verify the C++ wrapper, uev.hpp, callbacks bound at compile time */
+#include "check.h"
+#include "../src/uev.hpp"
+
+#include <sys/socket.h>
+
+using namespace libuev;
+
+static int ticks, posted;
+
+struct Conn {
+	Io   io;
+	int  reads = 0;
+
+	void on_read(Io &w, int events)
+	{
+		char buf[8];
+
+		fail_unless(&w == &io);
+		fail_unless(events == UEV_READ);
+		fail_unless(read(w.fd(), buf, sizeof(buf)) == 4);
+		reads++;
+	}
+};
+
+static Event ev;
+
+static void on_tick(Timer &w, int events)
+{
+	if (++ticks < 3)
+		return;
+
+	fail_unless(w.stop() == 0);
+	fail_unless(!w.active());
+	fail_unless(ev.post() == 0);
+}
+
+static void on_post(Event &w, int events)
+{
+	posted++;
+	w.loop().exit();
+}
+
+int main(void)
+{
+	Loop loop;
+	Conn conn;
+	Timer tmo;
+	int sv[2];
+
+	fail_unless(sizeof(Io) == sizeof(uev_t));
+	fail_unless(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+
+	fail_unless(conn.io.start<&Conn::on_read>(loop, &conn, sv[0], UEV_READ) == 0);
+	fail_unless(tmo.start<on_tick>(loop, 10, 10) == 0);
+	fail_unless(ev.start<on_post>(loop) == 0);
+	fail_unless(conn.io.active() && tmo.active() && ev.active());
+
+	fail_unless(write(sv[1], "ping", 4) == 4);
+	fail_unless(loop.run() == 0);
+
+	fail_unless(conn.reads == 1);
+	fail_unless(ticks == 3 && posted == 1);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
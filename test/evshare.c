@@ -0,0 +1,107 @@
+/* Verify event watchers sharing one eventfd, with a pending bitmap */
+#include "check.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#define NUM   5000
+#define STEP  7
+
+uev_t ev[NUM];
+int calls[NUM];
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	fail_unless(events == UEV_READ);
+	calls[w - ev]++;
+}
+
+static void *thread(void *arg)
+{
+	int i;
+
+	for (i = 0; i < NUM; i += STEP) {
+		fail_unless(uev_event_post(&ev[i]) == 0);
+		fail_unless(uev_event_post(&ev[i]) == 0);
+	}
+
+	return NULL;
+}
+
+static int total(void)
+{
+	int i, sum = 0;
+
+	for (i = 0; i < NUM; i++)
+		sum += calls[i];
+
+	return sum;
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	pthread_t tid;
+	uint64_t val;
+	uev_t last;
+	pid_t pid;
+	int i;
+
+	uev_init(&ctx);
+	fail_unless(uev_event_shared_set(&ctx, 1) == 0);
+	for (i = 0; i < NUM; i++) {
+		fail_unless(uev_event_init(&ctx, &ev[i], cb, NULL) == 0);
+		fail_unless(ev[i].fd == ev[0].fd);
+	}
+
+	/* Other thread, only the first post writes to the eventfd */
+	fail_unless(pthread_create(&tid, NULL, thread, NULL) == 0);
+	pthread_join(tid, NULL);
+	fail_unless(read(ev[0].fd, &val, sizeof(val)) == sizeof(val) && val == 1);
+	fail_unless(write(ev[0].fd, &val, sizeof(val)) == sizeof(val));
+
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	for (i = 0; i < NUM; i++)
+		fail_unless(calls[i] == (i % STEP ? 0 : 1));
+
+	/* Stopped watchers are not called, slots are reused */
+	fail_unless(uev_event_post(&ev[STEP]) == 0);
+	fail_unless(uev_event_stop(&ev[STEP]) == 0);
+	fail_unless(uev_event_post(&ev[STEP]) == -1 && errno == EINVAL);
+	fail_unless(uev_event_init(&ctx, &last, cb, NULL) == 0);
+	fail_unless(last.u.e.slot == STEP);
+	fail_unless(uev_event_post(&ev[1]) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(calls[1] == 1 && calls[STEP] == 1);
+	fail_unless(total() == (NUM + STEP - 1) / STEP + 1);
+	fail_unless(uev_event_stop(&last) == 0);
+
+	/* Bitmap is in shared memory, forked children can post */
+	pid = fork();
+	fail_unless(pid != -1);
+	if (!pid)
+		_exit(uev_event_post(&ev[NUM - 1]));
+	fail_unless(waitpid(pid, NULL, 0) == pid);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(calls[NUM - 1] == 1);
+
+	/* Loop exits when the last shared watcher is stopped */
+	for (i = 0; i < NUM; i++)
+		fail_unless(uev_event_stop(&ev[i]) == 0);
+	fail_unless(uev_run(&ctx, 0) == 0);
+
+	/* Own eventfd again */
+	fail_unless(uev_event_shared_set(&ctx, 0) == 0);
+	fail_unless(uev_event_init(&ctx, &ev[0], cb, NULL) == 0);
+	fail_unless(uev_event_init(&ctx, &ev[1], cb, NULL) == 0);
+	fail_unless(ev[0].fd != ev[1].fd);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
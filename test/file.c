@@ -0,0 +1,105 @@
+/* Verify file reader and I/O watchers on regular files */
+#include "check.h"
+#include <errno.h>
+#include <fcntl.h>
+
+#define SIZE (1024 * 1024 + 17)
+
+char file[] = "/tmp/uev-file-XXXXXX";
+size_t got, eof, nread, ticks;
+
+static void reader(uev_t *w, void *arg, int events)
+{
+	size_t i;
+
+	if (events & UEV_HUP) {
+		fail_unless(w->len == 0);
+		fail_unless(!uev_file_active(w));
+		eof++;
+		return;
+	}
+
+	fail_unless(events == UEV_READ);
+	for (i = 0; i < w->len; i++)
+		fail_unless((unsigned char)w->data[i] == (got + i) % 251);
+	got += w->len;
+}
+
+static void io(uev_t *w, void *arg, int events)
+{
+	char buf[4096];
+	ssize_t len;
+
+	fail_unless(events == UEV_READ);
+	len = read(w->fd, buf, sizeof(buf));
+	fail_unless(len >= 0);
+	if (!len)
+		fail_unless(!uev_io_active(w));
+	nread += len;
+}
+
+/* Other watchers must not be starved by always readable files */
+static void tick(uev_t *w, void *arg, int events)
+{
+	ticks++;
+}
+
+int main(void)
+{
+	unsigned char buf[4096];
+	uev_t w1, w2, w3, t;
+	uev_ctx_t ctx;
+	size_t i;
+	int fd, dfd, pfd[2];
+
+	fd = mkstemp(file);
+	fail_unless(fd >= 0);
+	for (i = 0; i < SIZE; i++) {
+		buf[i % sizeof(buf)] = i % 251;
+		if ((i + 1) % sizeof(buf) == 0 || i + 1 == SIZE)
+			fail_unless(write(fd, buf, i % sizeof(buf) + 1) == (ssize_t)(i % sizeof(buf) + 1));
+	}
+	lseek(fd, 0, SEEK_SET);
+
+	uev_init(&ctx);
+
+	/* Not a regular file */
+	fail_unless(pipe(pfd) == 0);
+	fail_unless(uev_file_init(&ctx, &w3, reader, NULL, pfd[0]) == -1 && errno == EINVAL);
+	fail_unless(uev_file_open(&ctx, &w3, reader, NULL, "/nonexistent") == -1);
+
+	/* Never readable, no always readable fallback for directories */
+	dfd = open("/tmp", O_RDONLY | O_DIRECTORY);
+	fail_unless(dfd >= 0);
+	fail_unless(uev_io_init(&ctx, &w3, io, NULL, dfd, UEV_READ) == -1 && errno == EPERM);
+	fail_unless(!uev_io_active(&w3));
+	close(dfd);
+
+	fail_unless(uev_file_open(&ctx, &w1, reader, NULL, file) == 0);
+	fail_unless(uev_io_init(&ctx, &w2, io, NULL, fd, UEV_READ) == 0);
+	fail_unless(uev_io_active(&w2));
+	uev_event_init(&ctx, &t, tick, NULL);
+
+	/* Returns when both files are read and all watchers stopped */
+	uev_event_post(&t);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(ticks == 1);
+	uev_event_stop(&t);
+	fail_unless(uev_run(&ctx, 0) == 0);
+
+	fail_unless(got == SIZE && eof == 1);
+	fail_unless(nread == SIZE);
+	fail_unless(w1.fd == -1);
+
+	close(fd);
+	unlink(file);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
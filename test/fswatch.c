@@ -0,0 +1,90 @@
+/* Verify inotify based file system watchers sharing one descriptor */
+#include "check.h"
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+char dir[] = "/tmp/uev-fswatch-XXXXXX";
+char file[64];
+int created, modified, deleted, ignored;
+uint32_t last;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	fail_unless(events == UEV_READ);
+	last = w->mask;
+
+	if (w->mask & IN_CREATE) {
+		fail_unless(w->name && !strcmp(w->name, "foo"));
+		created++;
+	}
+	if (w->mask & IN_MODIFY)
+		modified++;
+	if (w->mask & IN_DELETE)
+		deleted++;
+	if (w->mask & IN_IGNORED) {
+		fail_unless(!uev_fswatch_active(w));
+		ignored++;
+	}
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	uev_t w1, w2, w3;
+	int fd;
+
+	fail_unless(mkdtemp(dir) != NULL);
+	snprintf(file, sizeof(file), "%s/foo", dir);
+
+	uev_init(&ctx);
+	fail_unless(uev_fswatch_init(&ctx, &w1, cb, NULL, dir, IN_CREATE | IN_MODIFY) == 0);
+	fail_unless(uev_fswatch_init(&ctx, &w2, cb, NULL, dir, IN_DELETE) == 0);
+	fail_unless(w1.fd == w2.fd);
+	fail_unless(uev_fswatch_init(&ctx, &w3, cb, NULL, "/nonexistent", IN_DELETE) != 0);
+
+	fd = open(file, O_CREAT | O_WRONLY, 0600);
+	fail_unless(fd >= 0);
+	fail_unless(write(fd, "a", 1) == 1);
+	fail_unless(write(fd, "b", 1) == 1);
+	close(fd);
+	unlink(file);
+
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(created == 1);
+	fail_unless(modified == 1);
+	fail_unless(deleted == 1);
+
+	/* Not coalesced with the first create, would lose the delete */
+	fd = open(file, O_CREAT | O_WRONLY, 0600);
+	fail_unless(fd >= 0);
+	close(fd);
+	unlink(file);
+	fd = open(file, O_CREAT | O_WRONLY, 0600);
+	fail_unless(fd >= 0);
+	close(fd);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(created == 3 && deleted == 2);
+	fail_unless(last == IN_CREATE);
+	unlink(file);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(deleted == 3 && last == IN_DELETE);
+
+	/* Kernel watch is kept until last watcher on path is stopped */
+	fail_unless(uev_fswatch_stop(&w1) == 0);
+	fail_unless(!uev_fswatch_active(&w1));
+	fail_unless(uev_fswatch_active(&w2));
+
+	rmdir(dir);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(ignored == 1);
+	fail_unless(!uev_fswatch_active(&w2));
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,116 @@
+/* Verify fswatch callbacks may stop, free, and exit, run with ASan */
+#include "check.h"
+#include <fcntl.h>
+#include <sys/inotify.h>
+
+char dir[] = "/tmp/uev-fswexit-XXXXXX";
+char file[64];
+int calls, ignored, exits;
+
+static void touch(const char *name)
+{
+	int fd;
+
+	snprintf(file, sizeof(file), "%s/%s", dir, name);
+	fd = open(file, O_CREAT | O_WRONLY, 0600);
+	fail_unless(fd >= 0);
+	close(fd);
+	unlink(file);
+}
+
+static uev_t *watch(uev_ctx_t *ctx, uev_cb_t *cb, void *arg, uint32_t mask)
+{
+	uev_t *w;
+
+	w = malloc(sizeof(*w));
+	fail_unless(w != NULL);
+	fail_unless(uev_fswatch_init(ctx, w, cb, arg, dir, mask) == 0);
+
+	return w;
+}
+
+/* Stop and free the other watcher on the same path */
+static void stopper(uev_t *w, void *arg, int events)
+{
+	uev_t **other = (uev_t **)arg;
+
+	calls++;
+	fail_unless(*other != NULL);
+	fail_unless(uev_fswatch_stop(*other) == 0);
+	free(*other);
+	*other = NULL;
+}
+
+/* Free itself when the kernel has removed the watch */
+static void freer(uev_t *w, void *arg, int events)
+{
+	if (w->mask & IN_IGNORED) {
+		ignored++;
+		free(w);
+	}
+}
+
+/* Exit the loop, releasing all file system watchers */
+static void exiter(uev_t *w, void *arg, int events)
+{
+	exits++;
+	uev_exit(w->ctx);
+}
+
+int main(void)
+{
+	uev_t *a = NULL, *b = NULL, *w1, *w2;
+	uev_ctx_t ctx;
+
+	fail_unless(mkdtemp(dir) != NULL);
+
+	/* Callback stops and frees the next watcher in the same bucket */
+	uev_init(&ctx);
+	a = watch(&ctx, stopper, &b, IN_CREATE);
+	b = watch(&ctx, stopper, &a, IN_CREATE);
+	touch("foo");
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(calls == 1);
+	fail_unless((a == NULL) != (b == NULL));
+
+	if (a) {
+		uev_fswatch_stop(a);
+		free(a);
+	}
+	if (b) {
+		uev_fswatch_stop(b);
+		free(b);
+	}
+
+	/* Callback frees its own watcher on IN_IGNORED */
+	watch(&ctx, freer, NULL, IN_DELETE_SELF);
+	rmdir(dir);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(ignored == 1);
+	uev_exit(&ctx);
+
+	/* Callback calls uev_exit() with more events in the batch */
+	fail_unless(mkdtemp(strcpy(dir, "/tmp/uev-fswexit-XXXXXX")) != NULL);
+	uev_init(&ctx);
+	w1 = watch(&ctx, exiter, NULL, IN_CREATE | IN_DELETE);
+	w2 = watch(&ctx, exiter, NULL, IN_CREATE | IN_DELETE);
+	touch("foo");
+	touch("bar");
+	fail_unless(uev_run(&ctx, 0) == 0);
+	fail_unless(exits == 1);
+	fail_unless(!uev_fswatch_active(w1));
+	fail_unless(!uev_fswatch_active(w2));
+
+	free(w1);
+	free(w2);
+	rmdir(dir);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,75 @@
+/* Verify high resolution timers, absolute deadlines and overrun count */
+#include "check.h"
+
+#define PERIOD   500000ULL	/* 500 usec */
+#define DEADLINE 20000000ULL	/* 20 msec */
+
+uint64_t start, deadline;
+uint64_t ticks;
+uint64_t missed;
+uint64_t stall;
+int fired;
+uev_t periodic, oneshot;
+
+static void tick(uev_t *w, void *arg, int events)
+{
+	static int slept;
+
+	fail_unless(events != UEV_ERROR);
+
+	ticks  += 1 + w->overrun;
+	missed += w->overrun;
+
+	/* Overrun on the callback after falling behind, 10 periods */
+	if (slept == 1) {
+		stall = w->overrun;
+		slept++;
+	}
+
+	/* Fall behind once, should be reported as overrun */
+	if (!slept) {
+		usleep(5000);
+		slept++;
+	}
+
+	/* Done when both the stall and the deadline have been seen */
+	if (slept == 2 && fired) {
+		/* All expirations accounted for, none lost */
+		fail_unless(ticks >= (uev_now(w->ctx) - start) / PERIOD - 2);
+		fail_unless(stall >= 5 && missed >= stall);
+
+		uev_exit(w->ctx);
+	}
+}
+
+static void stop(uev_t *w, void *arg, int events)
+{
+	uint64_t now = uev_now(w->ctx);
+
+	fail_unless(events != UEV_ERROR);
+	fail_unless(now >= deadline);
+	fail_unless(!uev_timer_active(w));
+	fired = 1;
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+
+	uev_init(&ctx);
+
+	start    = uev_now(&ctx);
+	deadline = start + DEADLINE;
+	fail_unless(uev_hrtimer_init(&ctx, &periodic, tick, NULL, PERIOD, PERIOD, 0) == 0);
+	fail_unless(uev_hrtimer_init(&ctx, &oneshot, stop, NULL, deadline, 0, UEV_TIMER_ABSTIME) == 0);
+	fail_unless(uev_hrtimer_set(&oneshot, deadline, 0, 42) != 0);
+
+	return uev_run(&ctx, 0);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,81 @@
+/* Verify uev_invoke(), remote control of a context from other threads */
+#include "check.h"
+#include <errno.h>
+#include <pthread.h>
+
+#define NUM 10000
+
+uev_t tmr;
+int seq, fired;
+
+static void count(uev_ctx_t *ctx, void *arg)
+{
+	/* Run in the order invoked */
+	fail_unless((long)arg == seq);
+	seq++;
+}
+
+static void resched(uev_ctx_t *ctx, void *arg)
+{
+	fail_unless(uev_timer_set(&tmr, 1, 0) == 0);
+}
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	int now = seq;
+
+	fired++;
+
+	/* Same thread, called right away */
+	fail_unless(uev_invoke(w->ctx, count, (void *)(long)seq) == 0);
+	fail_unless(seq == now + 1);
+	uev_exit(w->ctx);
+}
+
+static void *thread(void *arg)
+{
+	uev_ctx_t *ctx = arg;
+	long i;
+
+	for (i = 1; i < NUM; i++)
+		fail_unless(uev_invoke(ctx, count, (void *)i) == 0);
+	fail_unless(uev_invoke(ctx, resched, NULL) == 0);
+
+	return NULL;
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	pthread_t tid;
+
+	uev_init(&ctx);
+	fail_unless(uev_invoke(NULL, count, NULL) == -1 && errno == EINVAL);
+
+	/* Loop not yet started, run when it is */
+	fail_unless(uev_invoke(&ctx, count, (void *)0L) == 0);
+	fail_unless(seq == 0);
+	fail_unless(uev_timer_init(&ctx, &tmr, cb, NULL, 10000, 0) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK) == 0);
+	fail_unless(seq == 1);
+
+	/* Timer rescheduled from another thread, which stops the loop */
+	fail_unless(pthread_create(&tid, NULL, thread, &ctx) == 0);
+	fail_unless(uev_run(&ctx, 0) == 0);
+	pthread_join(tid, NULL);
+	fail_unless(fired == 1);
+	fail_unless(seq == NUM + 1);
+
+	/* Not a watcher, the loop still exits without any */
+	uev_init(&ctx);
+	fail_unless(uev_run(&ctx, 0) == 0);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
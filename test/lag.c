@@ -0,0 +1,96 @@
+/* Verify loop lag monitor and overload hook */
+#include "check.h"
+#include <errno.h>
+
+#define PERIOD  10		/* msec */
+#define BUSY    15		/* msec, in each callback while overloaded */
+
+int max_lag, max_util;		/* Thresholds, usec and percent */
+int hooks[2];
+int busy = 1, laps;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void hook(uev_ctx_t *ctx, void *arg, int overload)
+{
+	struct uev_lag lag;
+
+	fail_unless(uev_lag_get(ctx, &lag) == 0);
+	fail_unless(lag.overload == overload);
+	hooks[overload]++;
+
+	/* Shed load */
+	if (overload) {
+		fail_unless((max_lag && lag.lag > max_lag * 1000ULL) ||
+			    (max_util && lag.util >= max_util));
+		busy = 0;
+	} else {
+		fail_unless(!max_lag || lag.lag < max_lag * 750ULL);
+		fail_unless(!max_util || lag.util <= max_util * 3 / 4 + 1);
+		uev_exit(ctx);
+	}
+}
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	uint64_t start = now();
+
+	while (busy && now() - start < BUSY * 1000000ULL)
+		;
+
+	/* Give up after 5 sec */
+	fail_unless(++laps < 5000 / PERIOD);
+}
+
+int main(void)
+{
+	struct uev_lag lag;
+	uev_ctx_t ctx;
+	uev_t tmr;
+
+	uev_init(&ctx);
+	fail_unless(uev_lag_set(&ctx, 2000, 101, hook, NULL) == -1 && errno == ERANGE);
+
+	/* Timers late, callbacks take longer than the period */
+	max_lag = 2000;
+	fail_unless(uev_lag_set(&ctx, max_lag, 0, hook, NULL) == 0);
+	fail_unless(uev_timer_init(&ctx, &tmr, cb, NULL, PERIOD, PERIOD) == 0);
+	fail_unless(uev_run(&ctx, 0) == 0);
+	fail_unless(hooks[1] == 1 && hooks[0] == 1);
+
+	/* Busy most of the time */
+	uev_init(&ctx);
+	max_lag  = 0;
+	max_util = 50;
+	busy = 1;
+	laps = 0;
+	fail_unless(uev_lag_set(&ctx, 0, max_util, hook, NULL) == 0);
+	fail_unless(uev_timer_init(&ctx, &tmr, cb, NULL, PERIOD, PERIOD) == 0);
+	fail_unless(uev_run(&ctx, 0) == 0);
+	fail_unless(hooks[1] == 2 && hooks[0] == 2);
+
+	/* Disabled, no more hooks */
+	uev_init(&ctx);
+	fail_unless(uev_lag_set(&ctx, 0, 0, NULL, NULL) == 0);
+	busy = 1;
+	laps = 0;
+	fail_unless(uev_timer_init(&ctx, &tmr, cb, NULL, PERIOD, PERIOD) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(uev_lag_get(&ctx, &lag) == 0 && lag.peak == 0);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
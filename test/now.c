@@ -0,0 +1,47 @@
+/* Verify cached loop time and timers armed relative to it */
+#include "check.h"
+
+#define TIMEOUT 100		/* 100 msec */
+
+uint64_t armed;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	uint64_t now = uev_now(w->ctx);
+
+	/* Same time for all callbacks until next wakeup */
+	usleep(1000);
+	fail_unless(uev_now(w->ctx) == now);
+
+	/* Fired at, or after, the deadline */
+	fail_unless(now >= armed + TIMEOUT * 1000000ULL);
+	fail_unless(uev_now_real(w->ctx) > 0);
+
+	fail_unless(uev_now_update(w->ctx) == 0);
+	fail_unless(uev_now(w->ctx) > now);
+
+	uev_exit(w->ctx);
+}
+
+int main(void)
+{
+	struct timespec ts;
+	uev_ctx_t ctx;
+	uev_t w;
+
+	uev_init(&ctx);
+	fail_unless(uev_now(&ctx) > 0);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	armed = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	uev_timer_init(&ctx, &w, cb, NULL, TIMEOUT, 0);
+
+	return uev_run(&ctx, 0);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,82 @@
+/* Verify uev_event_post() from the loop's own thread, another thread, and a child */
+#include "check.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+uev_t ev;
+int posts;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	fail_unless(events == UEV_READ);
+	posts++;
+}
+
+/* Same thread, no eventfd write, callback in the same iteration */
+static void local(uev_t *w, void *arg, int events)
+{
+	uint64_t val;
+
+	fail_unless(uev_event_post(&ev) == 0);
+	fail_unless(uev_event_post(&ev) == 0);
+	fail_unless(read(ev.fd, &val, sizeof(val)) == -1 && errno == EAGAIN);
+}
+
+static void *thread(void *arg)
+{
+	fail_unless(uev_event_post(&ev) == 0);
+	return NULL;
+}
+
+/* Child of a callback, same thread id, but must write to the eventfd */
+static void forked(uev_t *w, void *arg, int events)
+{
+	pid_t pid;
+
+	pid = fork();
+	fail_unless(pid != -1);
+	if (!pid)
+		_exit(uev_event_post(&ev));
+
+	fail_unless(waitpid(pid, NULL, 0) == pid);
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	pthread_t tid;
+	uev_t tmr;
+
+	uev_init(&ctx);
+	fail_unless(uev_event_init(&ctx, &ev, cb, NULL) == 0);
+
+	fail_unless(uev_timer_init(&ctx, &tmr, local, NULL, 1, 0) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(posts == 1);
+
+	/* Not running, e.g., before uev_run(), uses the eventfd */
+	fail_unless(uev_event_post(&ev) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(posts == 2);
+
+	fail_unless(pthread_create(&tid, NULL, thread, NULL) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(posts == 3);
+	pthread_join(tid, NULL);
+
+	fail_unless(uev_timer_init(&ctx, &tmr, forked, NULL, 1, 0) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(posts == 3);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(posts == 4);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
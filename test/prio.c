@@ -0,0 +1,70 @@
+/* Verify watchers are dispatched in priority order */
+#include "check.h"
+#include <fcntl.h>
+
+#define NUM 5
+
+int order[NUM];
+int num;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	char ch;
+
+	if (read(w->fd, &ch, 1) != 1)
+		fprintf(stderr, "read() failed, ignoring ...\n");
+
+	order[num++] = (int)(long)arg;
+}
+
+int main(void)
+{
+	uev_ctx_t ctx;
+	uev_t w[NUM];
+	int fds[NUM][2];
+	int prio[NUM] = { UEV_PRIO_MIN, 0, UEV_PRIO_MAX, -1, 1 };
+	int i;
+
+	uev_init(&ctx);
+
+	for (i = 0; i < NUM; i++) {
+		fail_unless(pipe2(fds[i], O_NONBLOCK) == 0);
+		fail_unless(uev_io_init(&ctx, &w[i], cb, (void *)(long)prio[i], fds[i][0], UEV_READ) == 0);
+		fail_unless(uev_prio_set(&w[i], prio[i]) == 0);
+		fail_unless(write(fds[i][1], "x", 1) == 1);
+	}
+	fail_unless(uev_prio_set(&w[0], UEV_PRIO_MAX + 1) != 0);
+
+	/* Highest priority set is polled first */
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(num == 1);
+	fail_unless(order[0] == UEV_PRIO_MAX);
+
+	/* The rest in one batch, highest first */
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(num == NUM);
+	for (i = 1; i < NUM; i++)
+		fail_unless(order[i] == UEV_PRIO_MAX - i);
+
+	/* Priority survives restart and changed events */
+	fail_unless(uev_io_set(&w[2], fds[2][0], UEV_READ) == 0);
+	fail_unless(uev_prio_set(&w[1], UEV_PRIO_MAX) == 0);
+	for (i = 0; i < NUM; i++)
+		fail_unless(write(fds[i][1], "x", 1) == 1);
+
+	num = 0;
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(num == 2);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(num == NUM);
+	fail_unless(order[NUM - 1] == UEV_PRIO_MIN);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
@@ -0,0 +1,130 @@
+/* Verify per-watcher profiling counters and watcher iterator */
+#include "check.h"
+#include <errno.h>
+#include <fcntl.h>
+
+static void burn(uev_t *w, void *arg, int events)
+{
+	struct timespec ts;
+	uint64_t start, now;
+	char ch;
+
+	read(w->fd, &ch, 1);
+
+	/* Burn 5 ms of thread CPU time */
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	do {
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		now = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	} while (now - start < 5000000);
+}
+
+static void light(uev_t *w, void *arg, int events)
+{
+	char ch;
+
+	read(w->fd, &ch, 1);
+}
+
+static void stop(uev_t *w, void *arg, int events)
+{
+	uev_timer_stop(w);
+}
+
+int main(void)
+{
+	uev_t busy, idle, tmr, *w, *first = NULL;
+	struct uev_stat st;
+	int a[2], b[2], num;
+	uev_ctx_t ctx, *gone;
+
+	fail_unless(pipe2(a, O_NONBLOCK) == 0);
+	fail_unless(pipe2(b, O_NONBLOCK) == 0);
+
+	uev_init(&ctx);
+	fail_unless(uev_io_init(&ctx, &busy, burn, NULL, a[0], UEV_READ) == 0);
+	fail_unless(uev_io_init(&ctx, &idle, light, NULL, b[0], UEV_READ) == 0);
+	fail_unless(uev_timer_init(&ctx, &tmr, stop, NULL, 1000, 0) == 0);
+
+	/* Disabled by default, nothing counted */
+	fail_unless(write(a[1], "x", 1) == 1);
+	uev_run(&ctx, UEV_ONCE);
+	fail_unless(busy.prof.count == 0);
+
+	fail_unless(uev_profile_set(&ctx, 1) == 0);
+	fail_unless(write(a[1], "xx", 2) == 2);
+	fail_unless(write(b[1], "x", 1) == 1);
+	uev_run(&ctx, UEV_ONCE);
+	uev_run(&ctx, UEV_ONCE);
+
+	fail_unless(write(b[1], "x", 1) == 1);
+	uev_run(&ctx, UEV_ONCE);
+
+	/* Counted by callbacks, e.g., on EAGAIN, only when enabled */
+	fail_unless(uev_stat_spurious(&idle) == 0);
+	fail_unless(uev_profile_set(&ctx, 0) == 0);
+	fail_unless(uev_stat_spurious(&idle) == 0);
+	fail_unless(idle.prof.spurious == 1);
+
+	num = 0;
+	for (w = uev_stat_next(&ctx, NULL, &st); w; w = uev_stat_next(&ctx, w, &st)) {
+		num++;
+		if (w == &busy) {
+			fail_unless(!strcmp(st.type, "io"));
+			fail_unless(st.fd == a[0] && st.events == UEV_READ);
+			fail_unless(st.count == 2);
+			fail_unless(st.cpu >= 10000000);
+			fail_unless(st.last && st.last <= uev_now(&ctx));
+		} else if (w == &idle) {
+			fail_unless(st.count == 2 && st.spurious == 1);
+			fail_unless(st.cpu < 5000000);
+		} else {
+			fail_unless(w == &tmr && !strcmp(st.type, "timer"));
+			fail_unless(st.count == 0);
+		}
+	}
+	fail_unless(num == 3);
+
+	/* The one last returned may be stopped, the rest are still visited */
+	num = 0;
+	for (w = uev_stat_next(&ctx, NULL, &st); w; w = uev_stat_next(&ctx, w, &st)) {
+		if (num++)
+			continue;
+
+		first = w;
+		if (w == &tmr)
+			uev_timer_stop(w);
+		else
+			uev_io_stop(w);
+	}
+	fail_unless(num == 3 && !uev_io_active(first));
+
+	/* Not in the list when stopped, counters cleared by _init() */
+	uev_io_stop(&idle);
+	fail_unless(uev_stat_next(&ctx, &busy, &st) != &idle);
+	fail_unless(uev_stat_next(&ctx, &tmr, &st) != &idle);
+	fail_unless(uev_io_init(&ctx, &idle, light, NULL, b[0], UEV_READ) == 0);
+	fail_unless(idle.prof.count == 0);
+
+	fail_unless(uev_stat_next(NULL, NULL, &st) == NULL && errno == EINVAL);
+	uev_exit(&ctx);
+
+	/* Stopping a stopped watcher must not touch its context, may be gone */
+	gone = malloc(sizeof(*gone));
+	fail_unless(gone != NULL);
+	fail_unless(uev_init(gone) == 0);
+	fail_unless(uev_io_init(gone, &idle, light, NULL, b[0], UEV_READ) == 0);
+	uev_exit(gone);
+	free(gone);
+	fail_unless(uev_io_stop(&idle) == 0);
+
+	return 0;
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
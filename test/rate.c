@@ -0,0 +1,105 @@
+/* Verify token bucket rate limit on I/O watchers, without extra fds */
+#include "check.h"
+#include <dirent.h>
+#include <errno.h>
+#include <sys/socket.h>
+
+#define CONNS  50
+#define RATE   100000		/* bytes/s */
+#define BURST  8192
+#define CHUNK  1024
+
+int sv[CONNS][2];
+size_t sent[CONNS], recvd[CONNS];
+
+static int fds(void)
+{
+	struct dirent *d;
+	DIR *dir;
+	int n = 0;
+
+	dir = opendir("/proc/self/fd");
+	fail_unless(dir != NULL);
+	while ((d = readdir(dir)))
+		n++;
+	closedir(dir);
+
+	return n;
+}
+
+static void writer(uev_t *w, void *arg, int events)
+{
+	size_t *num = arg;
+	char buf[CHUNK] = { 0 };
+
+	fail_unless(events == UEV_WRITE);
+	fail_unless(uev_io_rate_avail(w) > 0);
+	fail_unless(write(w->fd, buf, sizeof(buf)) == sizeof(buf));
+	fail_unless(uev_io_rate_consume(w, sizeof(buf)) == 0);
+	*num += sizeof(buf);
+}
+
+static void reader(uev_t *w, void *arg, int events)
+{
+	size_t *num = arg;
+	char buf[4 * CHUNK];
+	ssize_t len;
+
+	len = read(w->fd, buf, sizeof(buf));
+	fail_unless(len > 0);
+	*num += len;
+}
+
+int main(void)
+{
+	uev_t wr[CONNS], rd[CONNS];
+	uint64_t start, end;
+	double sec, min, max;
+	uev_ctx_t ctx;
+	int i, before;
+
+	uev_init(&ctx);
+	for (i = 0; i < CONNS; i++) {
+		fail_unless(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]) == 0);
+		fail_unless(uev_io_init(&ctx, &wr[i], writer, &sent[i], sv[i][0], UEV_WRITE) == 0);
+		fail_unless(uev_io_init(&ctx, &rd[i], reader, &recvd[i], sv[i][1], UEV_READ) == 0);
+	}
+
+	/* Argument checks, and an unlimited watcher has all the tokens */
+	fail_unless(uev_io_rate_set(&wr[0], RATE, 0) == -1 && errno == EINVAL);
+	fail_unless(uev_io_rate_consume(&wr[0], 1) == -1 && errno == EINVAL);
+	fail_unless(uev_io_rate_avail(&wr[0]) == UINT64_MAX);
+
+	before = fds();
+	for (i = 0; i < CONNS; i++) {
+		fail_unless(uev_io_rate_set(&wr[i], RATE, BURST) == 0);
+		fail_unless(uev_io_rate_avail(&wr[i]) == BURST);
+	}
+	fail_unless(fds() == before);
+
+	start = uev_now(&ctx);
+	fail_unless(uev_run_until(&ctx, start + 300000000ULL, 0) == 0);
+	uev_now_update(&ctx);
+	end = uev_now(&ctx);
+
+	/* Burst, then paced, with at most one chunk of debt */
+	sec = (end - start) / 1e9;
+	min = BURST + 0.5 * RATE * sec;
+	max = BURST + RATE * sec + CHUNK;
+	for (i = 0; i < CONNS; i++) {
+		fail_unless(sent[i] >= min && sent[i] <= max);
+		fail_unless(recvd[i] <= sent[i]);
+	}
+
+	/* Disabled again, no longer held back */
+	fail_unless(uev_io_rate_set(&wr[0], 0, 0) == 0);
+	fail_unless(uev_io_rate_avail(&wr[0]) == UINT64_MAX);
+
+	uev_exit(&ctx);
+	for (i = 0; i < CONNS; i++) {
+		close(sv[i][0]);
+		close(sv[i][1]);
+	}
+
+	return 0;
+}
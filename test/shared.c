@@ -0,0 +1,110 @@
+/* Verify separate reader and writer watchers on the same descriptor */
+#include "check.h"
+#include <sys/socket.h>
+
+int sv[2];
+int reads, writes, echoes;
+int shots, levels;
+
+static void reader(uev_t *w, void *arg, int events)
+{
+	char buf[16];
+
+	fail_unless(events == UEV_READ);
+	fail_unless(read(w->fd, buf, sizeof(buf)) == 4);
+	fail_unless(!memcmp(buf, "pong", 4));
+
+	if (++reads == 3)
+		uev_exit(w->ctx);
+}
+
+static void writer(uev_t *w, void *arg, int events)
+{
+	fail_unless(events == UEV_WRITE);
+	fail_unless(write(w->fd, "ping", 4) == 4);
+	writes++;
+
+	/* Reader on same fd must keep working */
+	uev_io_stop(w);
+}
+
+static void echo(uev_t *w, void *arg, int events)
+{
+	uev_t *sock = (uev_t *)arg;
+	char buf[16];
+
+	fail_unless(read(w->fd, buf, sizeof(buf)) == 4);
+	fail_unless(write(w->fd, "pong", 4) == 4);
+
+	/* Restart writer, once with reader at max priority */
+	if (++echoes == 1)
+		fail_unless(uev_prio_set(&sock[0], UEV_PRIO_MAX) == 0);
+	if (echoes < 3)
+		uev_io_start(&sock[1]);
+}
+
+/* Does not read, the descriptor stays readable */
+static void oneshot(uev_t *w, void *arg, int events)
+{
+	fail_unless(events == UEV_READ);
+	shots++;
+}
+
+static void level(uev_t *w, void *arg, int events)
+{
+	fail_unless(events == UEV_READ);
+	levels++;
+}
+
+int main(void)
+{
+	uev_t w[3];
+	uev_ctx_t ctx;
+	int i;
+
+	fail_unless(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+
+	uev_init(&ctx);
+	fail_unless(uev_io_init(&ctx, &w[0], reader, NULL, sv[0], UEV_READ) == 0);
+	fail_unless(uev_io_init(&ctx, &w[1], writer, NULL, sv[0], UEV_WRITE) == 0);
+	fail_unless(uev_io_init(&ctx, &w[2], echo, w, sv[1], UEV_READ) == 0);
+
+	fail_unless(uev_run(&ctx, 0) == 0);
+	fail_unless(reads == 3 && writes == 3 && echoes == 3);
+
+	/* Descriptor can be registered again after all watchers stopped */
+	uev_init(&ctx);
+	fail_unless(uev_io_init(&ctx, &w[1], writer, NULL, sv[0], UEV_WRITE) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE) == 0);
+	fail_unless(writes == 4);
+	uev_exit(&ctx);
+
+	/* One-shot reader fires once, even when sharing fd with a level reader */
+	uev_init(&ctx);
+	fail_unless(uev_io_init(&ctx, &w[0], oneshot, NULL, sv[0], UEV_READ | UEV_ONESHOT) == 0);
+	fail_unless(uev_io_init(&ctx, &w[1], level, NULL, sv[0], UEV_READ) == 0);
+	fail_unless(write(sv[1], "ping", 4) == 4);
+	for (i = 0; i < 5; i++)
+		uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(shots == 1 && levels == 5);
+
+	/* Rearmed by uev_io_start(), also after level reader is stopped */
+	fail_unless(uev_io_start(&w[0]) == 0);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(shots == 2 && levels == 6);
+	fail_unless(uev_io_stop(&w[1]) == 0);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(shots == 2);
+	fail_unless(uev_io_start(&w[0]) == 0);
+	uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK);
+	fail_unless(shots == 3);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */
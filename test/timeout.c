@@ -0,0 +1,66 @@
+/* Verify idle timeout on I/O watchers, restarted by each event */
+#include "check.h"
+#include <sys/socket.h>
+
+#define IDLE   100		/* msec */
+#define PERIOD 40		/* msec, writes before timeout */
+
+int sv[2];
+int reads, timeouts;
+uint64_t last;
+
+static void reader(uev_t *w, void *arg, int events)
+{
+	char buf[16];
+
+	if (events & UEV_TIMEOUT) {
+		/* Only after the last write, and not early */
+		fail_unless(reads == 3);
+		fail_unless(uev_now(w->ctx) - last >= IDLE * 1000000ULL);
+		if (++timeouts == 2) {
+			uev_io_stop(w);
+			uev_exit(w->ctx);
+		}
+		return;
+	}
+
+	fail_unless(events == UEV_READ);
+	fail_unless(read(w->fd, buf, sizeof(buf)) == 1);
+	last = uev_now(w->ctx);
+	reads++;
+}
+
+static void writer(uev_t *w, void *arg, int events)
+{
+	static int num = 0;
+
+	fail_unless(write(sv[1], "x", 1) == 1);
+	if (++num == 3)
+		uev_timer_stop(w);
+}
+
+int main(void)
+{
+	uev_t rd, tmr;
+	uev_ctx_t ctx;
+
+	fail_unless(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv) == 0);
+
+	uev_init(&ctx);
+	fail_unless(uev_io_init(&ctx, &rd, reader, NULL, sv[0], UEV_READ) == 0);
+	fail_unless(uev_io_timeout_set(&rd, -1) == -1);
+	fail_unless(uev_io_timeout_set(&rd, IDLE) == 0);
+	fail_unless(uev_timer_init(&ctx, &tmr, writer, NULL, PERIOD, PERIOD) == 0);
+
+	fail_unless(uev_run(&ctx, 0) == 0);
+	fail_unless(reads == 3 && timeouts == 2);
+
+	/* Kept when stopped, removed with uev_io_init() */
+	fail_unless(uev_init(&ctx) == 0);
+	fail_unless(uev_io_init(&ctx, &rd, reader, NULL, sv[0], UEV_READ) == 0);
+	fail_unless(uev_run(&ctx, UEV_ONCE | UEV_NONBLOCK) == 0);
+	fail_unless(timeouts == 2);
+	uev_exit(&ctx);
+
+	return 0;
+}
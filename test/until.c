@@ -0,0 +1,54 @@
+/* Verify bounded uev_run_until() slices with a periodic timer */
+#include <errno.h>
+#include "check.h"
+
+#define SLICE  3000000ULL	/* 3 msec */
+#define PERIOD 10		/* 10 msec */
+
+int ticks;
+
+static void cb(uev_t *w, void *arg, int events)
+{
+	ticks++;
+}
+
+int main(void)
+{
+	uint64_t deadline, now;
+	uev_ctx_t ctx;
+	uev_t w;
+	int i;
+
+	uev_init(&ctx);
+	fail_unless(uev_run_until(&ctx, 0, 0) == -1 && errno == EINVAL);
+	fail_unless(uev_run_until(&ctx, 1, UEV_NONBLOCK) == -1 && errno == EINVAL);
+
+	uev_timer_init(&ctx, &w, cb, NULL, PERIOD, PERIOD);
+
+	/* Frame loop, timer must not be rearmed by each slice */
+	deadline = uev_now(&ctx);
+	for (i = 0; i < 20; i++) {
+		deadline += SLICE;
+		fail_unless(uev_run_until(&ctx, deadline, 0) == 0);
+
+		/* Returns after the deadline, but not much later */
+		now = uev_now(&ctx);
+		fail_unless(now >= deadline);
+		fail_unless(now < deadline + 5 * SLICE);
+	}
+
+	/* 60 msec of slices with a 10 msec period */
+	fail_unless(ticks >= 4 && ticks <= 7);
+
+	/* Deadline already passed, returns immediately */
+	fail_unless(uev_run_until(&ctx, uev_now(&ctx), 0) == 0);
+
+	return uev_exit(&ctx);
+}
+
+/**
+ * Local Variables:
+ *  indent-tabs-mode: t
+ *  c-file-style: "linux"
+ * End:
+ */